@@ -0,0 +1,113 @@
+#include "Archive.h"
+
+/// <summary>
+/// Maps the archive, reads its header, verifies it and reads the metadata of all files
+/// (archives with section checksums have only their metadata verified here, every file is verified when it is read)
+/// </summary>
+/// <param name="path">path of the archive</param>
+/// <param name="checkWhole">whether to verify the whole archive in any case</param>
+/// <param name="pattern">how the archive is going to be read</param>
+/// <returns>false if the archive could not be read (the reason is printed)</returns>
+bool Archive::open(const std::string& path, bool checkWhole, accessPattern pattern)
+{
+	close();
+	if (!file.open(path)) {
+		std::cout << "The archive could not be opened!" << std::endl;
+		return false;
+	}
+
+	//only the hint is given here, the files are read ahead when they are extracted
+	file.advise(pattern);
+	Decoder parser;
+	archiveCursor cursor(file);
+	parser.readHeader(cursor);
+	formatVersion = parser.formatVersion;
+	formatFlags = parser.formatFlags;
+	blockSize = parser.blockSize;
+	headerSize = parser.headerSize;
+
+	if ((!(formatFlags & FLAG_SECTION_CHECKSUMS) || checkWhole) && !parser.checkArchive(file)) {
+		std::cout << "File is not safe for extraction or is not huffman compressed archive!" << std::endl;
+		close();
+		return false;
+	}
+
+	if (!parser.readMetaData(cursor, files, layout)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void Archive::close()
+{
+	file.close();
+	files.clear();
+	formatVersion = FORMAT_LEGACY;
+	formatFlags = 0;
+	blockSize = 0;
+	headerSize = 0;
+	layout = archiveLayout();
+}
+
+bool Archive::isOpen() const
+{
+	return file.isOpen();
+}
+
+const std::vector<fileInfo>& Archive::getFiles() const
+{
+	return files;
+}
+
+/// <summary>
+/// Finds a file by its name (the metadata is sorted by file name)
+/// </summary>
+/// <param name="name">name of the file (without path)</param>
+/// <returns>index of the file / -1 if not found</returns>
+long long Archive::find(const std::string& name) const
+{
+	auto it = std::lower_bound(files.begin(), files.end(), name, [](const fileInfo& file, const std::string& key) {
+		return file.name.compare(key) < 0;
+	});
+
+	if (it == files.end() || it->name != name)
+		return -1;
+
+	return it - files.begin();
+}
+
+archiveCursor Archive::cursor() const
+{
+	return archiveCursor(file);
+}
+
+const mappedFile& Archive::mapping() const
+{
+	return file;
+}
+
+uint16_t Archive::getFormat() const
+{
+	return formatVersion;
+}
+
+uint16_t Archive::getFormatFlags() const
+{
+	return formatFlags;
+}
+
+uint32_t Archive::getBlockSize() const
+{
+	return blockSize;
+}
+
+uint32_t Archive::getHeaderSize() const
+{
+	return headerSize;
+}
+
+const archiveLayout& Archive::getLayout() const
+{
+	return layout;
+}
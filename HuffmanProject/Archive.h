@@ -0,0 +1,40 @@
+#pragma once
+#include "Decoder.h"
+
+/// <summary>
+/// An archive opened for reading: the file is mapped and its header and metadata are parsed once.
+/// After open nothing changes, so any number of threads may read it at the same time without locks,
+/// every one of them with its own Decoder and cursor
+/// </summary>
+class Archive {
+	mappedFile file;
+	uint16_t formatVersion = FORMAT_LEGACY;
+	uint16_t formatFlags = 0;
+	uint32_t blockSize = 0; //size of the blocks large files are split into (FLAG_BLOCKS only)
+	uint32_t headerSize = 0; //size of the archive header (legacy archives have none)
+	std::vector<fileInfo> files; //metadata of the files, sorted by name
+	archiveLayout layout;
+public:
+	Archive() = default;
+	Archive(const Archive&) = delete;
+	Archive& operator=(const Archive&) = delete;
+
+	//maps and parses the archive (checkWhole - verify the whole archive even if it has section checksums),
+	//returns false if it cannot be read
+	bool open(const std::string& path, bool checkWhole = false, accessPattern pattern = accessPattern::sequential);
+	//unmaps the archive (it must not be read any more)
+	void close();
+	bool isOpen() const;
+
+	const std::vector<fileInfo>& getFiles() const;
+	//index of the file with the given name, -1 if there is none
+	long long find(const std::string& name) const;
+	//a new reading position in the archive, every thread needs its own
+	archiveCursor cursor() const;
+	const mappedFile& mapping() const;
+	uint16_t getFormat() const;
+	uint16_t getFormatFlags() const;
+	uint32_t getBlockSize() const;
+	uint32_t getHeaderSize() const;
+	const archiveLayout& getLayout() const;
+};
@@ -1,4 +1,5 @@
 #include "Decoder.h"
+#include "Archive.h"
 
 /// <summary>
 /// Can exctract, update, or display info about an archive based on command
@@ -18,31 +19,25 @@ bool Decoder::decode(const std::string& srcPath, const std::string& destPath,  c
 		return false;
 	}
 
-	if (fs::file_size(srcPath) > MAX_FILE_SIZE) {
-		std::cout << "Some of the specified files may be too large. File size must be less than "
-			<< (double)MAX_FILE_SIZE / (1024 * 1024 * 1024) << " GB" << std::endl;
+	//the archive is read directly from memory, the worker threads share the mapping.
+	//Only the metadata and one file are read for single file commands,
+	//an update copies the whole archive so it is checked whole
+	bool sequential = code == commandCode::extract || code == commandCode::update;
+	Archive archive;
+	if (!archive.open(srcPath, code == commandCode::update, sequential ? accessPattern::sequential : accessPattern::random))
 		return false;
-	}
-
-	if (!checkIntegrity(srcPath)) {
-		std::cout << "File is not safe for extraction or is not huffman compressed archive!" << std::endl;
-		return false;
-	}
-	rawBits.free();
-
-	std::ifstream file(srcPath, std::ios::out | std::ios::binary);
-
-	std::vector < fileInfo > files; //used to store the metadata
-	readMetaData(file, files);
 
+	useArchive(archive);
 	if (code == commandCode::extract) {
-		extractFiles(files, file, destPath);
+		if (!extractFiles(archive, destPath))
+			return false;
 	}
 	else if (code == commandCode::extractOne) { //check filename exists
-		extractOneFile(file, fileName, destPath, files);
+		if (!extractOneFile(archive, fileName, destPath))
+			return false;
 	}
 	else if (code == commandCode::info) {
-		printInfo(files);
+		printInfo(archive.getFiles());
 	}
 	else if (code == commandCode::update) {
 
@@ -51,13 +46,13 @@ bool Decoder::decode(const std::string& srcPath, const std::string& destPath,  c
 			return false;
 		}
 
-		if (fs::file_size(fileName) > MAX_FILE_SIZE) {
+		if (!(formatFlags & FLAG_LARGE) && fs::file_size(fileName) > MAX_FILE_SIZE) {
 			std::cout << "Some of the specified files may be too large. File size must be less than "
 				<< (double)MAX_FILE_SIZE / (1024 * 1024 * 1024) << " GB" << std::endl;
 			return false;
 		}
 
-		updateFile(srcPath, file, fileName, files, *enc);
+		updateFile(srcPath, archive, fileName, *enc);
 	}
 	
 	auto end = std::chrono::high_resolution_clock::now();
@@ -66,6 +61,94 @@ bool Decoder::decode(const std::string& srcPath, const std::string& destPath,  c
 	return true;
 }
 
+/// <summary>
+/// Decompresses a stream written by Encoder::encodeStream: the blocks are read one after another by their headers.
+/// The blocks are read in order, decoded on several threads and written in order,
+/// only a few of them are in memory at a time whatever the length of the stream
+/// </summary>
+/// <param name="srcStream">compressed input stream (it does not need to be seekable)</param>
+/// <param name="destStream">output stream</param>
+/// <returns>false if the decompressed stream could not be written, throws if the compressed one is not valid</returns>
+bool Decoder::decodeStream(std::istream& srcStream, std::ostream& destStream)
+{
+	struct streamBlock {
+		streamBlockHeader header;
+		std::vector<unsigned char> input;
+		std::vector<unsigned char> data;
+	};
+
+	archiveHeader header;
+	uint32_t streamBlockSize = 0;
+	srcStream.read((char*)&header, sizeof(header));
+	srcStream.read((char*)&streamBlockSize, sizeof(streamBlockSize));
+	if (!srcStream || header.signature != STREAM_SIGNATURE)
+		throw std::exception("This is not a huffman compressed stream!");
+
+	if (header.version != FORMAT_CANONICAL || (header.flags & ~FLAG_MULTI_STREAM) != 0)
+		throw std::exception("Stream format version is not supported!");
+
+	if (streamBlockSize < MIN_BLOCK_SIZE || streamBlockSize > MAX_BLOCK_SIZE)
+		throw std::exception("Block size is not correct. File has been corrupted!");
+
+	formatVersion = header.version;
+	formatFlags = header.flags;
+	blockSize = streamBlockSize;
+	headerSize = sizeof(header) + sizeof(streamBlockSize);
+
+	streamBlockHeader end; //the empty block ending the stream
+	uint32_t crc = 0; //checksum of the decompressed stream (of no data yet)
+	bool ended = false;
+	bool written = runOrderedInput<Decoder, streamBlock>(threadsCnt,
+		[this](Decoder& worker) {
+			setupWorker(worker, 1);
+		},
+		[&](size_t, streamBlock& block) {
+			if (ended)
+				return false;
+
+			if (!srcStream.read((char*)&block.header, sizeof(block.header)))
+				throw std::exception("The compressed stream is incomplete!");
+
+			if (block.header.size == 0) {
+				end = block.header;
+				ended = true;
+				return false;
+			}
+
+			//no code is longer than 2 bytes, the rest of the block is its code lengths and its jump table
+			if (block.header.size > blockSize || block.header.compressedSize > 2 * (uint64_t)blockSize)
+				throw std::exception("The compressed stream has been corrupted!");
+
+			block.input.resize(block.header.compressedSize);
+			if (!srcStream.read((char*)block.input.data(), block.input.size()))
+				throw std::exception("The compressed stream is incomplete!");
+			return true;
+		},
+		[](Decoder& worker, size_t, streamBlock& block) {
+			block.data.resize(block.header.size);
+			mappedFile source;
+			source.attach(block.input.data(), block.input.size());
+			archiveCursor cursor(source);
+			if (!worker.decodeBlock(cursor, 0, block.input.size(), block.data.data(), block.data.size())
+				|| crc_32::getChecksum(block.data.data(), block.data.size()) != block.header.checksum)
+				throw std::exception("The compressed stream has been corrupted!");
+		},
+		[&](size_t, streamBlock& block) {
+			destStream.write((const char*)block.data.data(), block.data.size());
+			crc = crc_32::combineCRC(crc, block.header.checksum, block.data.size());
+			return destStream.good();
+		});
+
+	if (!written)
+		return false;
+
+	if (end.compressedSize != 0 || end.checksum != crc)
+		throw std::exception("The compressed stream has been corrupted!");
+
+	destStream.flush();
+	return destStream.good();
+}
+
 /// <summary>
 /// Prints Info about all files
 /// </summary>
@@ -91,115 +174,367 @@ bool Decoder::checkIntegrity(const std::string& srcPath)
 	if (!fs::exists(srcPath))
 		throw fs::filesystem_error("Compressed file specified does not exist!", std::error_code());
 
-	if(fs::file_size(srcPath)>=MAX_FILE_SIZE)
-		throw fs::filesystem_error("File is too big and cannot be a huffman compressed file", std::error_code());
+	mappedFile archive;
+	if (!archive.open(srcPath))
+		throw fs::filesystem_error("Compressed file could not be opened!", std::error_code());
 
-	uint32_t fileCrc = 0;
-	uintmax_t fileSize = fs::file_size(srcPath);
-	std::ifstream fileIn(srcPath, std::ios::in | std::ios::binary);
-	//reading the archived file checksum
-	uint32_t crc = crc_32::getFileChecksum(fileIn, fileSize - sizeof(uint32_t));
-	fileIn.clear();
-	fileIn.seekg(fileSize - sizeof(uint32_t), std::ios::beg);
-	//getting the early saved checksum of the file
-	fileIn.read(reinterpret_cast<char*>(&fileCrc), sizeof(fileCrc));
-	std::streamsize read = fileIn.gcount();
+	archive.advise(accessPattern::sequential);
+	return checkArchive(archive);
+}
 
-	if (read != sizeof(fileCrc))
+/// <summary>
+/// Computes the checksum of the mapped archive (without its last 4 bytes) and compares it with the saved one
+/// </summary>
+/// <param name="archive">the mapped archive</param>
+/// <returns>true - if file is OK, false - if file has been broken</returns>
+bool Decoder::checkArchive(const mappedFile& archive)
+{
+	if (archive.size() < sizeof(uint32_t))
 		throw std::exception("Could not read crc32.");
 
-	if (crc == fileCrc) //if the two checksums are equal, then the file is intact
+	//getting the early saved checksum of the file
+	uint64_t checksumPos = archive.size() - sizeof(uint32_t);
+	uint32_t fileCrc = 0;
+	archiveCursor(archive, checksumPos).read(&fileCrc, sizeof(fileCrc));
+
+	if (getRegionChecksum(archive, 0, checksumPos) == fileCrc) //if the two checksums are equal, then the file is intact
 		return true;
 
 	return false;
 }
 
+/// <summary>
+/// Compares the metadata (everything up to the files checksums, or the header and the footer) with its checksum
+/// </summary>
+/// <param name="inFile">cursor in the mapped archive</param>
+/// <param name="layout">positions of the metadata</param>
+/// <returns>whether the metadata is intact</returns>
+bool Decoder::checkMetadata(archiveCursor& inFile, const archiveLayout& layout)
+{
+	if ((uint64_t)layout.metaChecksumPos + sizeof(uint32_t) > inFile.source().size())
+		return false;
+
+	uint32_t storedCrc = 0;
+	inFile.seek(layout.metaChecksumPos);
+	inFile.read(&storedCrc, sizeof(storedCrc));
+	const mappedFile& archive = inFile.source();
+	if (formatFlags & FLAG_FOOTER) {
+		uint64_t footerSize = layout.metaChecksumPos - layout.indexPos;
+		uint32_t crc = crc_32::combineCRC(getRegionChecksum(archive, 0, headerSize),
+			getRegionChecksum(archive, layout.indexPos, footerSize), footerSize);
+		return crc == storedCrc;
+	}
+	return getRegionChecksum(archive, 0, layout.metaChecksumPos) == storedCrc;
+}
+
+/// <summary>
+/// Compares a compressed file with its checksum (FLAG_SECTION_CHECKSUMS only)
+/// </summary>
+/// <param name="archive">the mapped archive</param>
+/// <param name="file">metadata of the file</param>
+/// <returns>whether the compressed file is intact</returns>
+bool Decoder::checkFile(const mappedFile& archive, const fileInfo& file)
+{
+	if (!(formatFlags & FLAG_SECTION_CHECKSUMS))
+		return true;
+
+	if (file.endPos < file.startPos || file.endPos > archive.size())
+		return false;
+
+	return getRegionChecksum(archive, file.startPos, file.endPos - file.startPos) == file.blobChecksum;
+}
+
+/// <summary>
+/// Computes the checksum of a part of the archive, viewing it a chunk at a time
+/// (an archive which is not mapped whole never has more than a chunk of it mapped)
+/// </summary>
+/// <param name="archive">the mapped archive</param>
+/// <param name="start">position of the first byte</param>
+/// <param name="count">number of bytes (they must be inside the archive)</param>
+/// <returns>the checksum, 0 if a part could not be mapped</returns>
+uint32_t Decoder::getRegionChecksum(const mappedFile& archive, uint64_t start, uint64_t count)
+{
+	mappedRegion region;
+	uint32_t crc = 0xFFFFFFFF;
+	while (count > 0) {
+		size_t chunkSize = (size_t)std::min<uint64_t>(count, VIEW_CHUNK_SIZE);
+		const unsigned char* chunk = archive.view(start, chunkSize, region);
+		if (!chunk)
+			return 0;
+
+		archive.prefetch(start + chunkSize, count - chunkSize); //the next chunk is read while this one is checksummed
+		crc_32::updateCRC(crc, chunk, chunkSize);
+		start += chunkSize;
+		count -= chunkSize;
+	}
+	return ~crc;
+}
+
 /// <summary>
 /// Reads metadata obout the files and stores it
 /// </summary>
-/// <param name="inFile">input file stream</param>
+/// <param name="inFile">cursor in the mapped archive</param>
 /// <param name="files">Stores metadata about files</param>
-void Decoder::readMetaData(std::ifstream& inFile, std::vector<fileInfo>& files)
+/// <param name="layout">Stores the positions of the metadata</param>
+/// <returns>false if the metadata could not be read</returns>
+bool Decoder::readMetaData(archiveCursor& inFile, std::vector<fileInfo>& files, archiveLayout& layout)
 {
-	uint32_t pathsEndPos = 0;
-	inFile.read(reinterpret_cast<char*>(&pathsEndPos), sizeof(pathsEndPos));
-	inFile.seekg(0, std::ios::end);
-
-	if (inFile.tellg() >= MAX_FILE_SIZE) {
+	readHeader(inFile);
+	if (!(formatFlags & FLAG_LARGE) && inFile.source().size() >= MAX_FILE_SIZE) {
 		throw std::exception("File is too big!");
 	}
 
-	uint32_t fileSize = (uint32_t)inFile.tellg();
-
-	if (pathsEndPos > fileSize) {
-		throw std::exception("File is corrupted and cant be extracted!");
+	readLayout(inFile, layout);
+	if ((formatFlags & FLAG_SECTION_CHECKSUMS) && !checkMetadata(inFile, layout)) {
+		std::cout << "The archive metadata has been corrupted. Cannot continue the extraction." << std::endl;
+		return false;
 	}
 
-	inFile.seekg(sizeof(pathsEndPos), std::ios::beg);
+	inFile.seek(layout.pathsPos);
 
 	std::string strPaths = "";
-	size_t idx = 0; //indicates index in the bit vector to know from where to read
-	size_t treeStorageSize = 0;
 	uint32_t filesCnt = 0;
 
 	//read tree and decode
 	uint32_t filesStrSize = 0;
-	inFile.read(reinterpret_cast<char*>(&filesStrSize), sizeof(filesStrSize));
+	inFile.read(&filesStrSize, sizeof(filesStrSize));
 
 	tree* t = nullptr;
-	if (!readTree(t, inFile, idx, treeStorageSize))
-	{
-		Encoder::freeTree(t);
-		std::cout << "Tree reading was NOT successful. Cannot continue the extraction." << std::endl;
-		return;
+	if (formatVersion == FORMAT_LEGACY) {
+		if (!readTree(t, inFile))
+		{
+			Encoder::freeTree(t);
+			std::cout << "Tree reading was NOT successful. Cannot continue the extraction." << std::endl;
+			return false;
+		}
+
+		//read filesStrSize bytes and decode into string
+		decodeFilePaths(strPaths, t, inFile, filesStrSize, layout.pathsEnd);
 	}
+	else {
+		decodeTable table;
+		if (!readCodeLengths(table, inFile))
+		{
+			std::cout << "Code lengths reading was NOT successful. Cannot continue the extraction." << std::endl;
+			return false;
+		}
 
-	//read filesStrSize bytes and decode into string
-	decodeFilePaths(strPaths, t, inFile, filesStrSize, idx);
+		decodeFilePaths(strPaths, table, inFile, filesStrSize, layout.pathsEnd);
+	}
 
-	inFile.clear();
-	inFile.seekg(pathsEndPos, std::ios::beg);
+	inFile.seek(layout.indexPos);
 
 	//saving the metadata of all files
-	inFile.read(reinterpret_cast<char*>(&filesCnt), sizeof(filesCnt));
+	inFile.read(&filesCnt, sizeof(filesCnt));
 	files.reserve(filesCnt);
 	
 	std::istringstream iss(strPaths);
 	std::string path;
-	uint32_t size, start, checksum, end;
+	uint64_t record[4] = {}; //size, start position, checksum and end position
 	while (std::getline(iss, path, EON))
 	{
-		inFile.read(reinterpret_cast<char*>(&size), sizeof(size));
-		inFile.read(reinterpret_cast<char*>(&start), sizeof(start));
-		inFile.read(reinterpret_cast<char*>(&checksum), sizeof(checksum));
-		inFile.read(reinterpret_cast<char*>(&end), sizeof(end));
+		if (!readPositions(inFile, record, 4))
+			record[0] = record[1] = record[2] = record[3] = 0;
 
 		std::string name;
 		Encoder::getFileName(path, name);
-		files.push_back(fileInfo{path, name, size, checksum, start, end});
+		files.push_back(fileInfo{path, name, record[0], (uint32_t)record[2], record[1], record[3]});
+	}
+
+	if (formatFlags & FLAG_SECTION_CHECKSUMS) {
+		for (fileInfo& file : files)
+			inFile.read(&file.blobChecksum, sizeof(file.blobChecksum));
 	}
 	Encoder::freeTree(t);
+	return true;
+}
+
+/// <summary>
+/// Reads where the paths and the metadata of the files are: the paths end position follows the header,
+/// archives with a footer have a trailer pointing at it instead (right before the archive checksum)
+/// </summary>
+/// <param name="inFile">cursor in the mapped archive positioned after the header</param>
+/// <param name="layout">Stores the positions of the metadata</param>
+void Decoder::readLayout(archiveCursor& inFile, archiveLayout& layout)
+{
+	uint64_t fileSize = inFile.source().size();
+	uint32_t filesCnt = 0;
+	bool sectionChecksums = (formatFlags & FLAG_SECTION_CHECKSUMS) != 0;
+	uint64_t positionSize = Encoder::positionSize(formatFlags);
+	//size, start position, checksum and end position of every file (and the checksum of the compressed file)
+	uint64_t recordSize = 4 * positionSize + (sectionChecksums ? sizeof(uint32_t) : 0);
+	if (!(formatFlags & FLAG_FOOTER)) {
+		uint64_t pathsEndPos = 0;
+		readPositions(inFile, &pathsEndPos, 1);
+		if (pathsEndPos > fileSize) {
+			throw std::exception("File is corrupted and cant be extracted!");
+		}
+
+		layout.pathsPos = headerSize + positionSize;
+		layout.pathsEnd = pathsEndPos;
+		layout.indexPos = pathsEndPos;
+		inFile.seek(layout.indexPos);
+		inFile.read(&filesCnt, sizeof(filesCnt));
+		uint64_t checksumPos = layout.indexPos + sizeof(filesCnt) + filesCnt * recordSize;
+		layout.metaChecksumPos = std::min(checksumPos, fileSize);
+		return;
+	}
+
+	uint64_t trailerSize = Encoder::trailerSize(formatFlags);
+	uint64_t metaEnd = (uint64_t)headerSize + sizeof(filesCnt) + sizeof(uint32_t); //at least the files count and the paths size
+	if (fileSize < metaEnd + trailerSize + sizeof(uint32_t)) {
+		throw std::exception("File is corrupted and cant be extracted!");
+	}
+
+	layout.trailerPos = fileSize - sizeof(uint32_t) - trailerSize;
+	uint64_t footerPos = 0;
+	uint32_t signature = 0;
+	inFile.seek(layout.trailerPos);
+	readPositions(inFile, &footerPos, 1);
+	inFile.read(&signature, sizeof(signature));
+	layout.pathsEnd = layout.trailerPos;
+	if (sectionChecksums)
+		layout.pathsEnd -= sizeof(uint32_t);
+	layout.metaChecksumPos = layout.pathsEnd;
+	if (signature != FOOTER_SIGNATURE || footerPos < headerSize || footerPos > layout.pathsEnd - sizeof(filesCnt)) {
+		throw std::exception("File is corrupted and cant be extracted!");
+	}
+
+	layout.indexPos = footerPos;
+	inFile.seek(layout.indexPos);
+	inFile.read(&filesCnt, sizeof(filesCnt));
+	layout.pathsPos = layout.indexPos + sizeof(filesCnt) + filesCnt * recordSize;
+	if (layout.pathsPos + sizeof(uint32_t) > layout.pathsEnd) {
+		throw std::exception("File is corrupted and cant be extracted!");
+	}
+}
+
+/// <summary>
+/// Reads sizes or positions: 64-bit numbers in archives with FLAG_LARGE, 32-bit numbers in the rest
+/// </summary>
+/// <param name="inFile">cursor in the mapped archive</param>
+/// <param name="values">Stores the sizes or positions</param>
+/// <param name="count">how many to read</param>
+/// <returns>false (and nothing is read) if the archive ends before them</returns>
+bool Decoder::readPositions(archiveCursor& inFile, uint64_t* values, size_t count)
+{
+	if (formatFlags & FLAG_LARGE)
+		return inFile.read(values, count * sizeof(uint64_t));
+
+	const unsigned char* narrow = inFile.take(count * sizeof(uint32_t));
+	if (!narrow)
+		return false;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t value = 0;
+		memcpy(&value, narrow + i * sizeof(uint32_t), sizeof(value));
+		values[i] = value;
+	}
+	return true;
 }
 
 /// <summary>
 /// Extracts all files from the archive into their paths
-/// (paths begin from the dest path, then follow file path)
+/// (paths begin from the dest path, then follow file path).
+/// The largest files are extracted first, so no long file is left for the end to a single thread:
+/// files with enough blocks for all the threads are extracted one after another,
+/// the rest are extracted at the same time, each thread with its own decoder and cursor.
+/// Problems are reported in the order of the archive once all the files are extracted
 /// </summary>
-/// <param name="files">metadata</param>
-/// <param name="inFile">archive file stream</param>
+/// <param name="archive">the opened archive</param>
 /// <param name="destPath">extraction destination path</param>
-void Decoder::extractFiles(const std::vector<fileInfo>& files, std::ifstream& inFile, const std::string& destPath)
+/// <returns>false if some of the files has been corrupted (the rest are extracted)</returns>
+bool Decoder::extractFiles(const Archive& archive, const std::string& destPath)
 {
-
-	std::string fileFullPath;
+	const std::vector<fileInfo>& files = archive.getFiles();
+	archiveCursor inFile = archive.cursor();
 	size_t filesCnt = files.size();
+	std::vector<size_t> order(filesCnt);
 	for (size_t i = 0; i < filesCnt; i++)
+		order[i] = i;
+
+	std::stable_sort(order.begin(), order.end(), [&files](size_t a, size_t b) {
+		return files[a].size > files[b].size;
+	});
+
+	std::vector<extractStatus> statuses(filesCnt, extractStatus::extracted);
+	size_t aloneCnt = 0;
+	while (aloneCnt < filesCnt && extractedAlone(files[order[aloneCnt]]))
 	{
-		fileFullPath = destPath;
-		setupFilePath(files[i].path, fileFullPath);
-		std::ofstream outFile(fileFullPath, std::ios::out | std::ios::binary);
-		decodeFile(outFile, inFile, files[i].startPos, files[i].endPos, files[i].size);
+		size_t idx = order[aloneCnt++];
+		statuses[idx] = extractFile(inFile, files[idx], files[idx].path, destPath);
 	}
+
+	runParallel<Decoder>(filesCnt - aloneCnt, threadsCnt,
+		[this](Decoder& worker) {
+			setupWorker(worker, 1);
+		},
+		[&](Decoder& worker, size_t task) {
+			size_t idx = order[aloneCnt + task];
+			archiveCursor file = archive.cursor();
+			statuses[idx] = worker.extractFile(file, files[idx], files[idx].path, destPath);
+		});
+
+	bool intact = true;
+	for (size_t i = 0; i < filesCnt; i++)
+		intact &= reportStatus(files[i].path, statuses[i]);
+
+	return intact;
+}
+
+/// <summary>
+/// Takes the format of the archive, so the decoder can read its files
+/// </summary>
+/// <param name="archive">the opened archive</param>
+void Decoder::useArchive(const Archive& archive)
+{
+	formatVersion = archive.getFormat();
+	formatFlags = archive.getFormatFlags();
+	blockSize = archive.getBlockSize();
+	headerSize = archive.getHeaderSize();
+}
+
+/// <summary>
+/// Extracts one file of an archive which may be read by other threads at the same time
+/// (the archive is not changed, all the state of the extraction is in this decoder)
+/// </summary>
+/// <param name="archive">the opened archive</param>
+/// <param name="fileName">name of the file (without path)</param>
+/// <param name="destPath">destination full path</param>
+/// <returns>if the file has been found and extracted or not</returns>
+bool Decoder::extractOne(const Archive& archive, const std::string& fileName, const std::string& destPath)
+{
+	useArchive(archive);
+	return extractOneFile(archive, fileName, destPath);
+}
+
+/// <summary>
+/// Files with at least a block for every thread keep all the threads busy on their own
+/// </summary>
+/// <param name="file">metadata of the file</param>
+/// <returns>whether the file is extracted on its own</returns>
+bool Decoder::extractedAlone(const fileInfo& file) const
+{
+	return threadsCnt == 1 || (formatVersion != FORMAT_LEGACY && Encoder::usesBlocks(formatFlags, blockSize, file.size)
+		&& Encoder::blocksCount(blockSize, file.size) >= threadsCnt);
+}
+
+/// <summary>
+/// Prepares a decoder used by another thread to read the same archive
+/// </summary>
+/// <param name="worker">the decoder of the thread</param>
+/// <param name="threads">threads the worker may use to decode the blocks of a file</param>
+void Decoder::setupWorker(Decoder& worker, uint32_t threads) const
+{
+	worker.formatVersion = formatVersion;
+	worker.formatFlags = formatFlags;
+	worker.blockSize = blockSize;
+	worker.headerSize = headerSize;
+	worker.multiSymbol = multiSymbol;
+	worker.outputBuffSize = outputBuffSize;
+	worker.mappedOutput = mappedOutput;
+	worker.threadsCnt = threads;
 }
 
 /// <summary>
@@ -213,9 +548,10 @@ void Decoder::setupFilePath(const std::string& filePath, std::string& fullPath)
 	std::string directory;
 	while (std::getline(iss, directory, '\\'))
 	{
-		if (!fs::is_directory(fs::status(fullPath))) {
-			fs::create_directory(fullPath);
-		}
+		//several threads may create the same directory, it is enough that it exists afterwards
+		std::error_code error;
+		if (!fs::create_directory(fullPath, error) && !fs::is_directory(fs::status(fullPath)))
+			throw fs::filesystem_error("Directory could not be created", fullPath, error);
 
 		fullPath += '\\';
 		fullPath.append(directory);
@@ -225,87 +561,154 @@ void Decoder::setupFilePath(const std::string& filePath, std::string& fullPath)
 /// <summary>
 /// Exctracts a file from an archive
 /// </summary>
-/// <param name="outFile">destination file stream (extracted file)</param>
-/// <param name="srcFile">archived file stream</param>
+/// <param name="out">destination of the extracted file</param>
+/// <param name="srcFile">cursor in the mapped archive</param>
 /// <param name="start">start position of encoded file in archive</param>
 /// <param name="end">end position of encoded file in archive</param>
 /// <param name="size">size of the file before compression</param>
-void Decoder::decodeFile(std::ofstream& outFile, std::ifstream& srcFile, const size_t& start, const size_t& end, const size_t& size)
+/// <param name="checksum">checksum of the extracted bytes, computed while they are written</param>
+/// <returns>false if the compressed file could not be decoded (its code or its layout is corrupted)</returns>
+bool Decoder::decodeFile(extractOutput& out, archiveCursor& srcFile, const uint64_t& start, const uint64_t& end, const uint64_t& size, uint32_t& checksum)
 {
-	rawBits.free();
-	srcFile.clear();
-	srcFile.seekg(start, std::ios::beg);
+	srcFile.seek(start);
+	size_t count = (size_t)size; //only files split into blocks may be larger than MAX_FILE_SIZE
+	size_t cnt = 0;
+	uint32_t crc = 0xFFFFFFFF;
+	if (formatVersion != FORMAT_LEGACY) {
+		if (Encoder::usesBlocks(formatFlags, blockSize, size))
+			return decodeBlocks(out, srcFile, end, size, checksum);
+
+		decodeTable table;
+		if (!readCodeLengths(table, srcFile))
+			return false;
+
+		if (multiSymbol && count >= MULTI_SYMBOL_MIN_SIZE)
+			table.buildMulti();
+
+		if (Encoder::usesStreams(formatFlags, count))
+			return decodeStreams(table, out, srcFile, end, count, checksum);
+
+		readers[0].open(srcFile.source(), srcFile.tell(), end);
+		//a mapped file is decoded in place chunk by chunk too, so every chunk is still in the cache for its checksum
+		size_t buffSize = std::min((size_t)outputBuffSize, count);
+		std::unique_ptr<unsigned char[]> outBuffer(out.mapped ? nullptr : new unsigned char[buffSize]);
+		while (cnt < count)
+		{
+			size_t chunkSize = std::min(buffSize, count - cnt);
+			unsigned char* chunk = out.mapped ? out.mapped + cnt : outBuffer.get();
+			decodeSymbols(table, readers[0], chunk, chunkSize);
+			crc_32::updateCRC(crc, chunk, chunkSize);
+			out.write(chunk, chunkSize);
+			cnt += chunkSize;
+		}
+		checksum = crc ^ 0xFFFFFFFF;
+		return true;
+	}
+
 	tree* t = nullptr;
-	size_t idx = 0;
-	size_t treeStorageSize = 0;
-	if (!readTree(t, srcFile, idx, treeStorageSize)){
+	if (!readTree(t, srcFile)) {
 		Encoder::freeTree(t);
-		std::cout << "Tree reading was NOT successful. Cannot continue the extraction." << std::endl;
-		return;
+		return false;
 	}
-	std::unique_ptr<char[]> buffer(new char[BUFF_SIZE]);
-	unsigned char ch = 0;
-	size_t cnt = 0;
-	readFileChunk(srcFile, buffer, BUFF_SIZE);
-
-	while(cnt < size)
+	readers[0].open(srcFile.source(), srcFile.tell(), end);
+	size_t buffSize = std::min((size_t)outputBuffSize, count);
+	std::unique_ptr<unsigned char[]> outBuffer(out.mapped ? nullptr : new unsigned char[buffSize]);
+	while(cnt < count)
 	{
-		ensureBitsInVector(treeDepth, idx, srcFile, buffer, BUFF_SIZE);
-		ch = readSym(t, idx);
-		cnt++;
-		outFile.write((char*)&ch, sizeof(ch));
+		size_t chunkSize = std::min(buffSize, count - cnt);
+		unsigned char* chunk = out.mapped ? out.mapped + cnt : outBuffer.get();
+		for (size_t i = 0; i < chunkSize; i++)
+			chunk[i] = readSym(t, readers[0]);
+
+		crc_32::updateCRC(crc, chunk, chunkSize);
+		out.write(chunk, chunkSize);
+		cnt += chunkSize;
 	}
-
+	Encoder::freeTree(t);
+	checksum = crc ^ 0xFFFFFFFF;
+	return true;
 }
 
 /// <summary>
 /// Exctracts specified file from an archive (if exists)
 /// uses binary search in sorted data to find the file's positions in archive
 /// </summary>
-/// <param name="file">archived file stream</param>
+/// <param name="archive">the opened archive</param>
 /// <param name="fileName">name of the file (without path)</param>
 /// <param name="destPath">destination full path</param>
-/// <param name="files">list of all files (metadata)</param>
 /// <returns>if the file has been found and extracted or not</returns>
-bool Decoder::extractOneFile(std::ifstream& file, const std::string& fileName, std::string destPath, const std::vector<fileInfo>& files)
+bool Decoder::extractOneFile(const Archive& archive, const std::string& fileName, std::string destPath)
 {
-	long long index = binarySearchFile(files, 0, files.size() - 1, fileName);
+	long long index = archive.find(fileName);
 
 	if (index == -1)
 		return false;
 
-	setupFilePath(fileName, destPath);
-	std::ofstream outFile(destPath, std::ios::out | std::ios::binary);
-	decodeFile(outFile, file, files[index].startPos, files[index].endPos, files[index].size);
-
-	return true;
+	//the rest of the archive is not read, only this file is read ahead
+	const fileInfo& file = archive.getFiles()[index];
+	archive.mapping().advise(accessPattern::sequential, file.startPos, file.endPos - file.startPos);
+	archiveCursor cursor = archive.cursor();
+	return reportStatus(fileName, extractFile(cursor, file, fileName, destPath));
 }
 
 /// <summary>
-/// Assuming data about files is sorted by file name, finds needed file
+/// Checks a compressed file, creates its directories, decodes it and compares the checksum
+/// of the extracted bytes with the stored one, a file which could not be decoded or does not match is deleted.
+/// Large files are mapped and decoded in place, the rest are written through the output buffer.
+/// Nothing is printed, so several threads may extract files at the same time
 /// </summary>
-/// <param name="files">data about files (metadata)</param>
-/// <param name="left">left index</param>
-/// <param name="right">right index (size-1)</param>
-/// <param name="name">search key (file name)</param>
-/// <returns>int indexing file / -1 if not found</returns>
-long long Decoder::binarySearchFile(const std::vector<fileInfo>& files, long long left, long long right, const std::string& name)
+/// <param name="inFile">cursor in the mapped archive</param>
+/// <param name="file">metadata of the file</param>
+/// <param name="filePath">path of the file in the archive</param>
+/// <param name="destPath">extraction destination path</param>
+/// <returns>whether the file has been extracted correctly</returns>
+extractStatus Decoder::extractFile(archiveCursor& inFile, const fileInfo& file, const std::string& filePath, std::string destPath)
 {
-	if (right < left)
-		return -1;
+	//only the beginning of the file is requested, the rest is read ahead as it is decoded
+	inFile.source().prefetch(file.startPos, file.endPos - file.startPos);
+	if (!checkFile(inFile.source(), file))
+		return extractStatus::corrupted;
+
+	setupFilePath(filePath, destPath);
+	extractOutput out;
+	mappedFile mapping;
+	if (mappedOutput && file.size >= MAPPED_OUTPUT_MIN_SIZE && mapping.create(destPath, file.size)) {
+		out.mapped = mapping.writableData();
+	}
+	else if (file.size > outputBuffSize && mappedFile::preallocate(destPath, file.size)) {
+		//a file written in several buffers gets its space at once, it is opened without truncating it
+		out.stream.open(destPath, std::ios::in | std::ios::out | std::ios::binary);
+	}
+	else {
+		//the streams of a file are written at their own positions, the file grows to its size as they are written
+		out.stream.open(destPath, std::ios::out | std::ios::binary);
+	}
 
-	long long mid = (left + right) / 2;
-	
-	std::string thisName = files[mid].name;
-	int compResult = name.compare(thisName);
+	uint32_t crc = 0;
+	bool decoded = decodeFile(out, inFile, file.startPos, file.endPos, file.size, crc);
+	mapping.close();
+	out.stream.close();
+	if (decoded && crc == file.checksum)
+		return extractStatus::extracted;
 
-	if (compResult==0)
-		return mid;
+	fs::remove(destPath);
+	return decoded ? extractStatus::mismatch : extractStatus::corrupted;
+}
 
-	if (compResult < 0)
-		return binarySearchFile(files, left, mid - 1, name);
+/// <summary>
+/// Reports a file which has not been extracted
+/// </summary>
+/// <param name="filePath">path of the file in the archive</param>
+/// <param name="status">outcome of the extraction</param>
+/// <returns>whether the file has been extracted</returns>
+bool Decoder::reportStatus(const std::string& filePath, extractStatus status) const
+{
+	if (status == extractStatus::corrupted)
+		std::cout << "File " << filePath << " has been corrupted and was not extracted!" << std::endl;
+	else if (status == extractStatus::mismatch)
+		std::cout << "File " << filePath << " was not extracted correctly (checksum mismatch) and has been removed!" << std::endl;
 
-	return binarySearchFile(files, mid + 1, right, name);
+	return status == extractStatus::extracted;
 }
 
 /// <summary>
@@ -329,17 +732,17 @@ void Decoder::printFileInfo(const fileInfo& file) const
 /// computes checksum of the new archive file
 /// </summary>
 /// <param name="archivedPath">path of the archived file</param>
-/// <param name="archivedFile">input stream of the archived file</param>
+/// <param name="archive">the opened archive, it is closed before the archive is replaced</param>
 /// <param name="newFilePath">path of the new(updated) file </param>
-/// <param name="files">metadata for files</param>
 /// <param name="enc">encryptor used to compress the new version of the file</param>
-void Decoder::updateFile(const std::string& archivedPath, std::ifstream& archivedFile, const std::string& newFilePath, const std::vector<fileInfo>& files, Encoder& enc)
+void Decoder::updateFile(const std::string& archivedPath, Archive& archive, const std::string& newFilePath, Encoder& enc)
 {
 
 	//check if such file exists, get index
 	std::string newFileName = "";
 	Encoder::getFileName(newFilePath, newFileName);
-	long long index = binarySearchFile(files, 0, files.size()-1, newFileName);
+	const std::vector<fileInfo>& files = archive.getFiles();
+	long long index = archive.find(newFileName);
 	if (index < 0) {
 		std::cout << "File " << newFileName << " not found in the archive!" << std::endl;
 		return;
@@ -352,11 +755,11 @@ void Decoder::updateFile(const std::string& archivedPath, std::ifstream& archive
 	std::ifstream newFileStream(newFilePath, std::ios::in | std::ios::binary);
 
 	newFileStream.seekg(0, std::ios::end);
-	if (newFileStream.tellg() >= MAX_FILE_SIZE) {
+	if (!(formatFlags & FLAG_LARGE) && newFileStream.tellg() >= MAX_FILE_SIZE) {
 		throw std::exception("New file is too big for compression!");
 	}
 
-	uint32_t size = newFileStream.tellg();
+	uint64_t size = newFileStream.tellg();
 	newFileStream.seekg(0, std::ios::beg);
 	uint32_t newCheckSum = crc_32::getFileChecksum(newFileStream);
 
@@ -370,31 +773,34 @@ void Decoder::updateFile(const std::string& archivedPath, std::ifstream& archive
 	Encoder::pathStepBack(newArchivedPath);
 	newArchivedPath += '\\';
 	newArchivedPath.append("temp.bin");
-	uint32_t startFilePos = file.startPos;
-	uint32_t oldEndPos = file.endPos;
-	archivedFile.clear();
-	archivedFile.seekg(0, std::ios::beg);
+	uint64_t startFilePos = file.startPos;
+	uint64_t oldEndPos = file.endPos;
 
 	std::ofstream outNewArchived(newArchivedPath, std::ios::out | std::ios::binary);
-	copyFileContents(outNewArchived, archivedFile, startFilePos);
-
-	//write the new compressed file
-	uint32_t confirmCrc = enc.compressAndWrite(newFilePath, outNewArchived, newFileStream);
-	if (confirmCrc != newCheckSum || outNewArchived.tellp() >= MAX_FILE_SIZE) {
+	copyFileContents(outNewArchived, archive.mapping(), 0, startFilePos);
+
+	//write the new compressed file in the format of the archive
+	uint16_t encoderFormat = enc.getFormat();
+	uint16_t encoderFlags = enc.getFormatFlags();
+	uint32_t encoderBlockSize = enc.getBlockSize();
+	enc.setFormat(formatVersion, formatFlags, blockSize);
+	checksumBuf blobChecksum(outNewArchived.rdbuf());
+	std::ostream blobFile(&blobChecksum);
+	uint32_t confirmCrc = enc.compressAndWrite(newFilePath, blobFile, newFileStream);
+	enc.setFormat(encoderFormat, encoderFlags, encoderBlockSize);
+	if (confirmCrc != newCheckSum || (!(formatFlags & FLAG_LARGE) && outNewArchived.tellp() >= MAX_FILE_SIZE)) {
 		remove(archivedPath.c_str());
 		throw std::exception("Error occured compressing newer version of file!");
 	}
 
-	uint32_t newEndPos = outNewArchived.tellp();
+	uint64_t newEndPos = outNewArchived.tellp();
 
-	//write the rest of the files
-	archivedFile.seekg(0, std::ios::end);
-	size_t upperBound = (size_t)archivedFile.tellg() - oldEndPos;
-	archivedFile.seekg(oldEndPos, std::ios::beg);
-	copyFileContents(outNewArchived, archivedFile, upperBound);
+	//write the rest of the files (and the footer), the archive checksum is computed anew
+	uint64_t upperBound = archive.mapping().size() - sizeof(uint32_t) - oldEndPos;
+	copyFileContents(outNewArchived, archive.mapping(), oldEndPos, upperBound);
 
 	std::ifstream inNewArchived(newArchivedPath, std::ios::in | std::ios::binary);
-	changeMetadata(index, newEndPos, newCheckSum, size, oldEndPos, inNewArchived, outNewArchived, files);
+	changeMetadata(index, newEndPos, newCheckSum, blobChecksum.checksum(), size, oldEndPos, inNewArchived, outNewArchived, files, archive.getLayout());
 
 	std::string archivedFileName = "";
 	Encoder::getFileName(archivedPath, archivedFileName);
@@ -403,7 +809,7 @@ void Decoder::updateFile(const std::string& archivedPath, std::ifstream& archive
 	newArchivedPath += '\\';
 	newArchivedPath.append(archivedFileName);
 
-	archivedFile.close();
+	archive.close();
 	newFileStream.close();
 	outNewArchived.close();
 	inNewArchived.close();
@@ -420,25 +826,27 @@ void Decoder::updateFile(const std::string& archivedPath, std::ifstream& archive
 }
 
 /// <summary>
-/// Copies file contents from one file to another
+/// Copies mapped archive contents to a file (straight from the mapping, no intermediate buffer)
 /// </summary>
 /// <param name="outFile">outut file stream</param>
-/// <param name="inFile">input file stream</param>
+/// <param name="archive">the mapped archive</param>
+/// <param name="start">first byte to copy</param>
 /// <param name="upperBound"> how many bytes to copy </param>
-void Decoder::copyFileContents(std::ofstream& outFile, std::ifstream& inFile, const size_t upperBound)
+void Decoder::copyFileContents(std::ofstream& outFile, const mappedFile& archive, const uint64_t start, const uint64_t upperBound)
 {
-	size_t buffSize = std::min((size_t)BUFF_SIZE, upperBound);
-	char* buf = new char[buffSize];
-	size_t bytesLeft = upperBound;
-
-	do {
-		inFile.read(buf, buffSize);
-		bytesLeft -= buffSize;
-		buffSize = std::min(bytesLeft, buffSize);
-		outFile.write(buf, inFile.gcount());
-	} while (inFile.gcount() > 0 && buffSize > 0);
+	mappedRegion region;
+	for (uint64_t copied = 0; copied < upperBound; ) {
+		size_t chunkSize = (size_t)std::min<uint64_t>(upperBound - copied, VIEW_CHUNK_SIZE);
+		const unsigned char* chunk = archive.view(start + copied, chunkSize, region);
+		if (!chunk) {
+			outFile.setstate(std::ios::badbit);
+			return;
+		}
 
-	delete[] buf;
+		archive.prefetch(start + copied + chunkSize, upperBound - copied - chunkSize);
+		outFile.write((const char*)chunk, chunkSize);
+		copied += chunkSize;
+	}
 }
 
 /// <summary>
@@ -447,53 +855,76 @@ void Decoder::copyFileContents(std::ofstream& outFile, std::ifstream& inFile, co
 /// <param name="index">index of the updated file</param>
 /// <param name="newEndPos">new end position for updated file</param>
 /// <param name="newCheckSum">new checksum for updated file</param>
+/// <param name="newBlobCheckSum">checksum of the compressed updated file (FLAG_SECTION_CHECKSUMS only)</param>
 /// <param name="newSize">new size for updated file</param>
 /// <param name="oldEndPos">old end position before updating the file</param>
 /// <param name="inFile">input file stream of the archive</param>
 /// <param name="outFile">output file stream of the archive</param>
 /// <param name="files">list of files (metadata)</param>
-void Decoder::changeMetadata(const uint32_t index, const uint32_t newEndPos, const uint32_t newCheckSum, const uint32_t newSize,
-								const uint32_t oldEndPos, std::ifstream& inFile, std::ofstream& outFile, const std::vector<fileInfo>& files)
+/// <param name="layout">positions of the metadata in the old archive</param>
+void Decoder::changeMetadata(const uint32_t index, const uint64_t newEndPos, const uint32_t newCheckSum, const uint32_t newBlobCheckSum, const uint64_t newSize,
+								const uint64_t oldEndPos, std::ifstream& inFile, std::ofstream& outFile, const std::vector<fileInfo>& files, const archiveLayout& layout)
 {
 	inFile.clear();
 	outFile.clear();
 
-	inFile.seekg(0, std::ios::beg);
-
-	uint32_t filesStrEndPos = 0;
-	uint32_t filesCnt  = 0;
-	inFile.read((char*)&filesStrEndPos, sizeof(filesStrEndPos));
-
-	//read files cnt
-	inFile.seekg(filesStrEndPos);
-	inFile.read((char*)&filesCnt, sizeof(filesCnt));
-
-	uint32_t fileChangePos = filesStrEndPos + 4 * index * sizeof(uint32_t) + sizeof(filesCnt);
-
-	outFile.seekp(fileChangePos);
-	outFile.write((char*)&newSize, sizeof(newSize));
-
-	fileChangePos += 2 * sizeof(uint32_t); // over size and startpos
-	outFile.seekp(fileChangePos);
-	outFile.write((char*)&newCheckSum, sizeof(newCheckSum));
-	outFile.write((char*)&newEndPos, sizeof(newEndPos));
-	fileChangePos += 2 * sizeof(uint32_t); // over checksum and endPos
-	long diff = (long)newEndPos - oldEndPos;
-	uint32_t fileEndPos = 0;
-	uint32_t fileStratPos = 0;
+	size_t positionSize = Encoder::positionSize(formatFlags);
+	//writes a size or a position in the width of the archive (little-endian: a 32-bit one is the lower half)
+	auto writePosition = [&outFile, positionSize](uint64_t value) {
+		outFile.write((char*)&value, positionSize);
+	};
+
+	bool footer = (formatFlags & FLAG_FOOTER) != 0;
+	int64_t diff = (int64_t)newEndPos - (int64_t)oldEndPos;
+	//the footer moves together with the files after the updated one
+	uint64_t filesStrEndPos = footer ? layout.indexPos + diff : layout.indexPos;
+	uint32_t filesCnt = (uint32_t)files.size();
+
+	if (footer) {
+		//the trailer points at the moved footer
+		outFile.seekp(layout.trailerPos + diff);
+		writePosition(filesStrEndPos);
+	}
 
+	//size, start position, checksum and end position of the updated file and of the files after it
+	outFile.seekp(filesStrEndPos + sizeof(filesCnt) + 4 * index * positionSize);
+	writePosition(newSize);
+	writePosition(files[index].startPos);
+	writePosition(newCheckSum);
+	writePosition(newEndPos);
 	for (size_t i = index+1; i < filesCnt; i++)
 	{
-		fileStratPos = files[i].startPos + diff;
-		fileEndPos = files[i].endPos + diff;
-		fileChangePos += sizeof(uint32_t); //over filesize
-		outFile.seekp(fileChangePos);
-		outFile.write((char*)&fileStratPos, sizeof(fileStratPos));
-		fileChangePos += 2*sizeof(uint32_t); //over startpos and checksum
-		outFile.seekp(fileChangePos);
-		outFile.write((char*)&fileEndPos, sizeof(fileEndPos));
-		fileChangePos += sizeof(uint32_t); //over endpos
+		writePosition(files[i].size);
+		writePosition(files[i].startPos + diff);
+		writePosition(files[i].checksum);
+		writePosition(files[i].endPos + diff);
+	}
+
+	if (formatFlags & FLAG_SECTION_CHECKSUMS) {
+		//the checksums of the compressed files follow the metadata of all files
+		uint64_t blobChecksumsPos = filesStrEndPos + sizeof(filesCnt) + 4 * filesCnt * positionSize;
+		outFile.seekp(blobChecksumsPos + index * sizeof(uint32_t));
+		outFile.write((char*)&newBlobCheckSum, sizeof(newBlobCheckSum));
+
+		//then the checksum of all the metadata before (of the header and the footer for archives with a footer)
+		uint64_t metaChecksumPos = footer ? layout.metaChecksumPos + diff : blobChecksumsPos + filesCnt * sizeof(uint32_t);
+		outFile.flush();
+		inFile.clear();
+		inFile.seekg(0, std::ios::beg);
+		uint32_t metaChecksum = 0;
+		if (footer) {
+			uint64_t footerSize = metaChecksumPos - filesStrEndPos;
+			metaChecksum = crc_32::getFileChecksum(inFile, headerSize);
+			inFile.clear();
+			inFile.seekg(filesStrEndPos, std::ios::beg);
+			metaChecksum = crc_32::combineCRC(metaChecksum, crc_32::getFileChecksum(inFile, footerSize), footerSize);
+		}
+		else
+			metaChecksum = crc_32::getFileChecksum(inFile, metaChecksumPos);
+		outFile.seekp(metaChecksumPos);
+		outFile.write((char*)&metaChecksum, sizeof(metaChecksum));
 	}
+	outFile.flush();
 }
 
 /// <summary>
@@ -501,21 +932,18 @@ void Decoder::changeMetadata(const uint32_t index, const uint32_t newEndPos, con
 /// also computes tree depth
 /// </summary>
 /// <param name="t">tree node for the result</param>
-/// <param name="file">input file stream</param>
-/// <param name="idx">index in bit vector</param>
-/// <param name="treeStorageSize">tree srorage size in bytes</param>
+/// <param name="file">cursor in the mapped archive</param>
 /// <returns>wether the tree has been successfully read</returns>
-bool Decoder::readTree(tree*& t, std::ifstream& file, size_t& idx, size_t& treeStorageSize)
+bool Decoder::readTree(tree*& t, archiveCursor& file)
 {
 	uint32_t treeSize = 0; //size of the tree in bits
 	size_t treeStorage = 0; //tree stored in bytes
 
 	//reading the size of the tree
-	file.read((char*)(&treeSize), sizeof(treeSize));
+	file.read(&treeSize, sizeof(treeSize));
 
-	if (treeSize > MAX_TREE_SIZE) {
-		throw std::exception("Size of tree is not correct. File has been corrupted!");
-	}
+	if (treeSize > MAX_TREE_SIZE)
+		return false;
 	//bits to bytes
 	if (treeSize % BYTE_SIZE != 0) {
 		treeStorage = (size_t)(treeSize / BYTE_SIZE) + 1;
@@ -524,24 +952,20 @@ bool Decoder::readTree(tree*& t, std::ifstream& file, size_t& idx, size_t& treeS
 		treeStorage /= BYTE_SIZE;
 	}
 
-	treeStorageSize = treeStorage;
-
 	//reading the tree itself
-	std::unique_ptr<char[]> treeBuffer(new char[treeStorageSize]);
+	uint64_t treeStart = file.tell();
 	size_t treeDepth = 0;
 
-	readFileChunk(file, treeBuffer, treeStorageSize);
-	readTreeRec(t, idx);
+	readers[0].open(file.source(), treeStart, treeStart + treeStorage);
+	readTreeRec(t, readers[0]);
 	//getting tree depth
 	getTreeDepth(t, 0, treeDepth);
 	this->treeDepth = treeDepth;
-	//free bitvector and reset index
-	rawBits.free();
-	idx = 0;
 
 	//read end of tree symbol to ensure tree is read correctly
+	file.seek(treeStart + treeStorage);
 	unsigned char ch = 0;
-	file.read((char*)(&ch), sizeof(ch));
+	file.read(&ch, sizeof(ch));
 
 	return (ch == EOT);
 }
@@ -550,131 +974,505 @@ bool Decoder::readTree(tree*& t, std::ifstream& file, size_t& idx, size_t& treeS
 /// reads tree
 /// </summary>
 /// <param name="t">current tree node</param>
-/// <param name="idx">index in bit vector</param>
-void Decoder::readTreeRec(tree*& t, size_t& idx)
+/// <param name="reader">input of the stored tree</param>
+void Decoder::readTreeRec(tree*& t, bitReader& reader)
 {
 	tree* left = nullptr;
 	tree* right = nullptr;
 
-	bool bit = rawBits[idx];
-	idx++;
+	reader.refill();
+	bool bit = reader.peek() & 1;
+	reader.consume(1);
 
 	// if its not a leaf
 	if (bit == 1) {
-		readTreeRec(left, idx);
-		readTreeRec(right, idx);
+		readTreeRec(left, reader);
+		readTreeRec(right, reader);
 		t = new tree(0, 0, left, right);
 	}
 	else { //it is a leaf
 		//read next 8 bits
-		unsigned char sym = readTreeSym(idx);
+		unsigned char sym = readTreeSym(reader);
 		t = new tree(0, sym);
 	}
 
 }
 
+/// <summary>
+/// reads the code lengths table of a canonical Huffman code and builds its decoding table
+/// </summary>
+/// <param name="table">the resulting table</param>
+/// <param name="file">cursor in the mapped archive</param>
+/// <returns>wether the code has been successfully read</returns>
+bool Decoder::readCodeLengths(decodeTable& table, archiveCursor& file)
+{
+	uint16_t storedSize = 0;
+	file.read(&storedSize, sizeof(storedSize));
+
+	//the lengths are unpacked straight from the mapping
+	const unsigned char* stored = file.take(storedSize);
+	if (!stored)
+		return false;
+
+	uint32_t lengths[CHARS_CNT];
+	return canonicalCode::unpackLengths(stored, storedSize, lengths) && table.build(lengths);
+}
+
+/// <summary>
+/// reads the archive header and sets the format version
+/// (legacy archives begin with the paths end position so nothing is consumed for them)
+/// </summary>
+/// <param name="inFile">cursor in the mapped archive</param>
+void Decoder::readHeader(archiveCursor& inFile)
+{
+	archiveHeader header;
+	inFile.seek(0);
+
+	if (inFile.read(&header, sizeof(header)) && header.signature == ARCHIVE_SIGNATURE) {
+		if (header.version != FORMAT_CANONICAL || (header.flags & ~KNOWN_FLAGS) != 0)
+			throw std::exception("Archive format version is not supported!");
+
+		formatVersion = header.version;
+		formatFlags = header.flags;
+		headerSize = sizeof(header);
+		if (formatFlags & FLAG_BLOCKS) {
+			if (!inFile.read(&blockSize, sizeof(blockSize)) || blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE)
+				throw std::exception("Block size is not correct. File has been corrupted!");
+
+			headerSize += sizeof(blockSize);
+		}
+	}
+	else {
+		formatVersion = FORMAT_LEGACY;
+		formatFlags = 0;
+		headerSize = 0;
+	}
+
+	inFile.seek(headerSize);
+}
+
 /// <summary>
 /// reads symbol stored in tree
 /// </summary>
-/// <param name="idx">index indicating position in bit vector</param>
+/// <param name="reader">input of the stored tree</param>
 /// <returns>needed byte (symbol)</returns>
-unsigned char Decoder::readTreeSym(size_t& idx)
+unsigned char Decoder::readTreeSym(bitReader& reader)
+{
+	reader.refill();
+	unsigned char sym = (unsigned char)reader.peek();
+	reader.consume(TREE_DATA_SIZE);
+	return sym;
+}
+
+/// <summary>
+/// decodes symbol bit by bit using the tree
+/// </summary>
+/// <param name="t">the huffman coding tree</param>
+/// <param name="reader">input of the compressed data</param>
+/// <returns>decoded byte (symbol)</returns>
+unsigned char Decoder::readSym(const tree* t, bitReader& reader)
 {
-	std::bitset<TREE_DATA_SIZE> bitSym;
-	for (size_t i = 0; i < TREE_DATA_SIZE; i++)
+	while (t->left || t->right)
 	{
-		bitSym[i] = rawBits[idx];
-		idx++;
+		if (reader.bitsLeft() == 0)
+			reader.refill();
+
+		t = (reader.peek() & 1) ? t->right : t->left;
+		reader.consume(1);
 	}
-	return (unsigned char)bitSym.to_ulong();
+	return t->sym;
+}
+
+/// <summary>
+/// Used to decode file paths metadata
+/// </summary>
+/// <param name="paths">result path as whole string</param>
+/// <param name="t">huffman coding tree</param>
+/// <param name="file">cursor in the mapped archive</param>
+/// <param name="storageSize">storage size of the string paths metadata</param>
+/// <param name="end">end position of the paths metadata in the archive</param>
+void Decoder::decodeFilePaths(std::string& paths, const tree* t, archiveCursor& file, const size_t& storageSize, const uint64_t& end)
+{
+	readers[0].open(file.source(), file.tell(), end);
+	for (size_t i = 0; i < storageSize; i++)
+	{
+		paths += readSym(t, readers[0]);
+	}
+}
+
+void Decoder::setMultiSymbol(bool enabled)
+{
+	multiSymbol = enabled;
+}
+
+void Decoder::setMappedOutput(bool enabled)
+{
+	mappedOutput = enabled;
+}
+
+bool Decoder::setThreads(uint32_t count)
+{
+	if (count == 0)
+		return false;
+
+	threadsCnt = count;
+	return true;
+}
+
+bool Decoder::setOutputBufferSize(uint32_t size)
+{
+	if (size < MIN_OUTPUT_BUFF_SIZE || size > MAX_OUTPUT_BUFF_SIZE)
+		return false;
+
+	outputBuffSize = size;
+	return true;
+}
+
+/// <summary>
+/// Used to decode file paths metadata stored with a canonical code
+/// </summary>
+/// <param name="paths">result path as whole string</param>
+/// <param name="table">decoding table of the canonical code</param>
+/// <param name="file">cursor in the mapped archive</param>
+/// <param name="storageSize">storage size of the string paths metadata</param>
+/// <param name="end">end position of the paths metadata in the archive</param>
+void Decoder::decodeFilePaths(std::string& paths, const decodeTable& table, archiveCursor& file, const size_t& storageSize, const uint64_t& end)
+{
+	paths.resize(storageSize);
+	readers[0].open(file.source(), file.tell(), end);
+	if (storageSize > 0)
+		decodeSymbols(table, readers[0], (unsigned char*)&paths[0], storageSize);
 }
 
 /// <summary>
-/// given a buffer and a file loads the bits of the file into a vector
+/// Decodes symbols with table lookups. After every refill as many lookups as surely fit
+/// in the bit buffer are done without checking it again.
+/// If the table has multi-symbol entries, they are used while there is space for all their symbols
 /// </summary>
-/// <param name="file">stream of the file</param>
-/// <param name="buffer">The buffer</param>
-/// <param name="storageSize">The size of data to be put in the buffer</param>
-/// <param name="rawBits">the product vector of bits</param>
-size_t Decoder::readFileChunk(std::ifstream& file, std::unique_ptr<char[]>& buffer, size_t storageSize)
+/// <param name="table">decoding table of the canonical code</param>
+/// <param name="reader">input of the stream</param>
+/// <param name="out">where to put the symbols</param>
+/// <param name="count">how many symbols to decode</param>
+void Decoder::decodeSymbols(const decodeTable& table, bitReader& reader, unsigned char* out, size_t count)
 {
-	file.read(buffer.get(), storageSize);
-	size_t charsCnt = file.gcount();
+	uint32_t maxLength = table.maxCodeLength();
+	size_t perRefill = maxLength ? (WORD_SIZE - BYTE_SIZE) / maxLength : count;
+	size_t cnt = 0;
+
+	if (table.hasMulti()) {
+		//a lookup takes at most TABLE_BITS bits (or maxLength if the first code is longer)
+		size_t lookups = (WORD_SIZE - BYTE_SIZE) / std::max(TABLE_BITS, maxLength);
+		while (count - cnt >= lookups * MAX_ENTRY_SYMBOLS)
+		{
+			reader.refill();
+			for (size_t i = 0; i < lookups; i++)
+			{
+				const multiEntry& multi = table.lookupMulti(reader.peek());
+				if (multi.count != 0) {
+					//all the symbols are copied at once, only count of them are kept
+					memcpy(out + cnt, &multi.syms, MAX_ENTRY_SYMBOLS);
+					cnt += multi.count;
+					reader.consume(multi.length);
+				}
+				else {
+					const decodeEntry& entry = table.lookup(reader.peek());
+					out[cnt++] = entry.sym;
+					reader.consume(entry.length);
+				}
+			}
+		}
+	}
 
-	std::vector<std::bitset<BYTE_SIZE>> bits;
-	//read every byte into this vector
-	for (size_t i = 0; i < charsCnt; i++)
+	while (cnt < count)
 	{
-		bits.push_back(std::bitset<BYTE_SIZE>(buffer[i]));
+		reader.refill();
+		size_t batch = std::min(perRefill, count - cnt);
+		for (size_t i = 0; i < batch; i++)
+		{
+			const decodeEntry& entry = table.lookup(reader.peek());
+			out[cnt++] = entry.sym;
+			reader.consume(entry.length);
+		}
 	}
-	//load all into bitVector
-	for (size_t i = 0; i < charsCnt; i++)
+}
+
+/// <summary>
+/// Decodes a file written as STREAMS_CNT streams chunk by chunk.
+/// Every chunk is written to the part of the file its stream holds
+/// </summary>
+/// <param name="table">decoding table of the canonical code</param>
+/// <param name="out">destination of the extracted file</param>
+/// <param name="srcFile">cursor in the mapped archive positioned at the jump table</param>
+/// <param name="end">end position of encoded file in archive</param>
+/// <param name="size">size of the file before compression</param>
+/// <param name="checksum">checksum of the extracted bytes</param>
+/// <returns>false if the stream sizes are not correct</returns>
+bool Decoder::decodeStreams(const decodeTable& table, extractOutput& out, archiveCursor& srcFile, const uint64_t& end, const size_t& size, uint32_t& checksum)
+{
+	size_t counts[STREAMS_CNT];
+	if (!openStreams(srcFile, end, size, counts))
+		return false;
+
+	//every stream is a consecutive part of the file, their checksums are combined at the end
+	uint32_t crcs[STREAMS_CNT];
+	for (uint32_t i = 0; i < STREAMS_CNT; i++)
+		crcs[i] = 0xFFFFFFFF;
+
+	size_t segment = (size_t)Encoder::streamSegment(size);
+	//the output buffer is shared by the streams (a mapped file is decoded in place)
+	size_t buffSize = std::min((size_t)outputBuffSize / STREAMS_CNT, counts[0]);
+	std::unique_ptr<unsigned char[]> outBuffer(out.mapped ? nullptr : new unsigned char[STREAMS_CNT * buffSize]);
+	unsigned char* outs[STREAMS_CNT];
+	size_t chunks[STREAMS_CNT];
+	for (size_t done = 0; done < counts[0]; done += buffSize)
 	{
-		for (size_t j = 0; j < BYTE_SIZE; j++)
+		for (uint32_t i = 0; i < STREAMS_CNT; i++)
+		{
+			outs[i] = out.mapped ? out.mapped + std::min(size, i * segment + done) : outBuffer.get() + i * buffSize;
+			chunks[i] = std::min(buffSize, counts[i] - std::min(counts[i], done));
+		}
+
+		decodeStreamChunks(table, outs, chunks);
+		for (uint32_t i = 0; i < STREAMS_CNT; i++)
 		{
-			rawBits.push_back(bits[i][j]);
+			if (chunks[i] == 0)
+				continue;
+
+			crc_32::updateCRC(crcs[i], outs[i], chunks[i]);
+			if (!out.mapped)
+				out.stream.seekp(i * segment + done, std::ios::beg);
+			out.write(outs[i], chunks[i]);
 		}
 	}
-	
-	return charsCnt;
+
+	checksum = 0;
+	for (uint32_t i = 0; i < STREAMS_CNT; i++)
+		checksum = crc_32::combineCRC(checksum, crcs[i] ^ 0xFFFFFFFF, counts[i]);
+	return true;
 }
 
 /// <summary>
-/// decodes symbol from bit vector using the tree
+/// Reads the jump table and points a reader to every stream (the table follows the streams in archives with a footer)
 /// </summary>
-/// <param name="t">the huffman coding tree</param>
-/// <param name="idx">index in bit vector</param>
-/// <returns>decoded byte (symbol)</returns>
-unsigned char Decoder::readSym(const tree* t, size_t& idx)
+/// <param name="srcFile">cursor in the mapped archive positioned at the jump table or at the first stream</param>
+/// <param name="end">end position of the streams in archive</param>
+/// <param name="size">size of the data before compression</param>
+/// <param name="counts">symbols in every stream, the last stream holds the fewest</param>
+/// <returns>whether the stream sizes are valid</returns>
+bool Decoder::openStreams(archiveCursor& srcFile, const uint64_t& end, const size_t& size, size_t* counts)
 {
-	if (!(t->left || t->right))
-		return t->sym;
+	uint32_t streamSizes[STREAMS_CNT - 1] = {};
+	uint64_t streamsEnd = end;
+	if (formatFlags & FLAG_FOOTER) {
+		if (end < srcFile.tell() + sizeof(streamSizes))
+			return false;
+
+		streamsEnd = end - sizeof(streamSizes);
+		uint64_t streamsStart = srcFile.tell();
+		srcFile.seek(streamsEnd);
+		srcFile.read(streamSizes, sizeof(streamSizes));
+		srcFile.seek(streamsStart);
+	}
+	else if (!srcFile.read(streamSizes, sizeof(streamSizes)))
+		return false;
+
+	size_t segment = (size_t)Encoder::streamSegment(size);
+	uint64_t streamStart = srcFile.tell();
+	for (uint32_t i = 0; i < STREAMS_CNT; i++)
+	{
+		uint64_t streamEnd = i < STREAMS_CNT - 1 ? streamStart + streamSizes[i] : streamsEnd;
+		if (streamEnd > streamsEnd)
+			return false;
 
-	if (rawBits[idx] == 0)
-		return readSym(t->left, ++idx);
+		readers[i].open(srcFile.source(), streamStart, streamEnd);
+		counts[i] = std::min(segment, size - std::min(size, i * segment));
+		streamStart = streamEnd;
+	}
+	return true;
+}
 
-	return readSym(t->right, ++idx);
+/// <summary>
+/// Decodes the next chunks[i] symbols of every stream into outs[i]
+/// (the chunks of the later streams are never larger)
+/// </summary>
+/// <param name="table">decoding table of the canonical code</param>
+/// <param name="outs">where to put the symbols of every stream</param>
+/// <param name="chunks">how many symbols to decode from every stream</param>
+void Decoder::decodeStreamChunks(const decodeTable& table, unsigned char* const* outs, const size_t* chunks)
+{
+	//the multi-symbol loop already decodes several symbols per lookup, it goes stream by stream
+	size_t common = table.hasMulti() ? 0 : chunks[STREAMS_CNT - 1];
+	decodeInterleaved(table, outs, common);
+	for (uint32_t i = 0; i < STREAMS_CNT; i++)
+	{
+		if (chunks[i] > common)
+			decodeSymbols(table, readers[i], outs[i] + common, chunks[i] - common);
+	}
 }
 
 /// <summary>
-/// Used to decode file paths metadata
+/// Decodes a file split into blocks: the blocks are decoded on several threads (each with its own decoder
+/// and cursor in the shared mapping) straight into a mapped file, or into memory and written to the file in order
 /// </summary>
-/// <param name="paths">result path as whole string</param>
-/// <param name="t">huffman coding tree</param>
-/// <param name="file">input file stream of archive</param>
-/// <param name="storageSize">storage size of the string paths metadata</param>
-/// <param name="idx">index position in bit vector</param>
-void Decoder::decodeFilePaths(std::string& paths, const tree* t, std::ifstream& file, const size_t& storageSize, size_t& idx)
+/// <param name="out">destination of the extracted file</param>
+/// <param name="srcFile">cursor in the mapped archive positioned at the block end positions
+/// (at the first block in archives with a footer, the end positions follow the blocks)</param>
+/// <param name="end">end position of encoded file in archive</param>
+/// <param name="size">size of the file before compression</param>
+/// <param name="checksum">checksum of the extracted bytes</param>
+/// <returns>false if the block positions are not correct or a block could not be decoded</returns>
+bool Decoder::decodeBlocks(extractOutput& out, archiveCursor& srcFile, const uint64_t& end, const uint64_t& size, uint32_t& checksum)
 {
-	char ch = 0;
-	//size_t size = std::min(storageSize, BUFF_SIZE);
-	std::unique_ptr<char[]> buffer(new char[BUFF_SIZE]);
-	readFileChunk(file, buffer, BUFF_SIZE);
-	for (size_t i = 0; i < storageSize; i++)
+	struct blockWorker {
+		Decoder dec;
+	};
+
+	struct decodedBlock {
+		std::vector<unsigned char> data; //the decoded block (empty for mapped files)
+		uint32_t checksum = 0; //checksum of the block, combined into the file's one in order
+		bool decoded = false; //a block which could not be decoded stops the extraction of the file
+	};
+
+	size_t blocksCnt = Encoder::blocksCount(blockSize, size);
+	std::vector<uint64_t> blockEnds(blocksCnt);
+	size_t tableSize = blocksCnt * Encoder::positionSize(formatFlags);
+	uint64_t blocksEnd = end;
+	bool read = false;
+	if (formatFlags & FLAG_FOOTER) {
+		uint64_t first = srcFile.tell(); //the first block
+		if (end >= first + tableSize) {
+			blocksEnd = end - tableSize;
+			srcFile.seek(blocksEnd);
+			read = readPositions(srcFile, blockEnds.data(), blocksCnt);
+			srcFile.seek(first);
+		}
+	}
+	else
+		read = readPositions(srcFile, blockEnds.data(), blocksCnt);
+	uint64_t blocksStart = srcFile.tell();
+	for (size_t i = 0; i < blocksCnt; i++)
 	{
-		ensureBitsInVector(treeDepth, idx, file, buffer, BUFF_SIZE);
-		ch = readSym(t, idx);
-		paths += ch;
+		if (!read || (i > 0 && blockEnds[i] < blockEnds[i - 1])
+			|| blocksStart + blockEnds[i] > blocksEnd)
+			return false;
 	}
-	rawBits.free();
-	idx = 0;
+
+	uint32_t crc = 0; //checksum of the file (of no data yet)
+	bool decoded = runOrdered<blockWorker, decodedBlock>(blocksCnt, threadsCnt,
+		[this](blockWorker& worker) {
+			setupWorker(worker.dec, 1);
+		},
+		[&](blockWorker& worker, size_t idx, decodedBlock& result) {
+			uint64_t start = blocksStart + (idx > 0 ? blockEnds[idx - 1] : 0);
+			size_t count = (size_t)std::min<uint64_t>(blockSize, size - (uint64_t)idx * blockSize);
+			//the threads fill different parts of a mapped file at the same time
+			unsigned char* block = nullptr;
+			if (out.mapped) {
+				block = out.mapped + idx * blockSize;
+			}
+			else {
+				result.data.resize(count);
+				block = result.data.data();
+			}
+
+			archiveCursor file(srcFile.source());
+			if (!worker.dec.decodeBlock(file, start, blocksStart + blockEnds[idx], block, count))
+				return;
+
+			result.checksum = crc_32::getChecksum(block, count);
+			result.decoded = true;
+		},
+		[&](size_t idx, decodedBlock& result) {
+			if (!result.decoded)
+				return false;
+
+			size_t count = (size_t)std::min<uint64_t>(blockSize, size - (uint64_t)idx * blockSize);
+			out.write(result.data.data(), count);
+			crc = crc_32::combineCRC(crc, result.checksum, count);
+			return true;
+		});
+	checksum = crc;
+	return decoded;
 }
 
 /// <summary>
-/// makes sure bit vector has at least bitsCnt bits for the next read request
-/// usually I check with the depth of the tree as the maximum length of encoded byte
+/// Decodes a whole block (its code and its single or multiple streams) into memory
 /// </summary>
-/// <param name="bitsCnt">bits needed to be available for the next read</param>
-/// <param name="idx">index of the next bit to be read</param>
-/// <param name="file">input file stream</param>
-/// <param name="buffer">buffer needed to read new data</param>
-/// <param name="storageSize">how many bytes to read next (or size of buffer)</param>
-void Decoder::ensureBitsInVector(const size_t bitsCnt, size_t& idx, std::ifstream& file, std::unique_ptr<char[]>& buffer, size_t storageSize)
+/// <param name="srcFile">cursor in the mapped archive</param>
+/// <param name="start">start position of the block in archive</param>
+/// <param name="end">end position of the block in archive</param>
+/// <param name="out">where to put the block</param>
+/// <param name="size">size of the block before compression</param>
+/// <returns>whether the block has been decoded</returns>
+bool Decoder::decodeBlock(archiveCursor& srcFile, const uint64_t& start, const uint64_t& end, unsigned char* out, const size_t& size)
 {
-	if (idx >= rawBits.size() - bitsCnt) {
-		rawBits.free(idx, true);
-		idx = 0;
-		readFileChunk(file, buffer, storageSize);
+	srcFile.seek(start);
+	decodeTable table;
+	if (!readCodeLengths(table, srcFile))
+		return false;
+
+	if (multiSymbol && size >= MULTI_SYMBOL_MIN_SIZE)
+		table.buildMulti();
+
+	if (Encoder::usesStreams(formatFlags, size)) {
+		size_t counts[STREAMS_CNT];
+		if (!openStreams(srcFile, end, size, counts))
+			return false;
+
+		size_t segment = (size_t)Encoder::streamSegment(size);
+		unsigned char* outs[STREAMS_CNT];
+		for (uint32_t i = 0; i < STREAMS_CNT; i++)
+			outs[i] = out + std::min(size, i * segment);
+
+		decodeStreamChunks(table, outs, counts);
+		return true;
+	}
+
+	readers[0].open(srcFile.source(), srcFile.tell(), end);
+	decodeSymbols(table, readers[0], out, size);
+	return true;
+}
+
+/// <summary>
+/// Decodes the same number of symbols from every stream. The lookups of the different streams
+/// do not depend on each other, so the processor can do them at the same time
+/// </summary>
+/// <param name="table">decoding table of the canonical code</param>
+/// <param name="outs">where to put the symbols of every stream</param>
+/// <param name="count">how many symbols to decode from every stream</param>
+void Decoder::decodeInterleaved(const decodeTable& table, unsigned char* const* outs, size_t count)
+{
+	static_assert(STREAMS_CNT == 4, "the loop is written for 4 streams");
+
+	uint32_t maxLength = table.maxCodeLength();
+	size_t perRefill = maxLength ? (WORD_SIZE - BYTE_SIZE) / maxLength : count;
+	bitReader& reader0 = readers[0];
+	bitReader& reader1 = readers[1];
+	bitReader& reader2 = readers[2];
+	bitReader& reader3 = readers[3];
+	size_t cnt = 0;
+	while (cnt < count)
+	{
+		reader0.refill();
+		reader1.refill();
+		reader2.refill();
+		reader3.refill();
+		size_t batch = std::min(perRefill, count - cnt);
+		for (size_t i = 0; i < batch; i++, cnt++)
+		{
+			const decodeEntry& entry0 = table.lookup(reader0.peek());
+			const decodeEntry& entry1 = table.lookup(reader1.peek());
+			const decodeEntry& entry2 = table.lookup(reader2.peek());
+			const decodeEntry& entry3 = table.lookup(reader3.peek());
+			reader0.consume(entry0.length);
+			reader1.consume(entry1.length);
+			reader2.consume(entry2.length);
+			reader3.consume(entry3.length);
+			outs[0][cnt] = entry0.sym;
+			outs[1][cnt] = entry1.sym;
+			outs[2][cnt] = entry2.sym;
+			outs[3][cnt] = entry3.sym;
+		}
 	}
 }
 
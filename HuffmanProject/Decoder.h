@@ -1,5 +1,15 @@
 #pragma once
 #include "Encoder.h"
+#include "decodeTable.h"
+#include "bitReader.h"
+#include <cstring>
+
+class Archive;
+
+const uint32_t DEFAULT_OUTPUT_BUFF_SIZE = 1024 * 1024; //decoded bytes written to the extracted file at once
+const uint32_t MIN_OUTPUT_BUFF_SIZE = 4 * 1024;
+const uint32_t MAX_OUTPUT_BUFF_SIZE = 64 * 1024 * 1024;
+const uint32_t MAPPED_OUTPUT_MIN_SIZE = 64 * 1024 * 1024; //smaller files are written faster through the output buffer (page faults cost more than the copy)
 
 /// <summary>
 /// A structure to store a single file metadata
@@ -7,10 +17,47 @@
 struct fileInfo {
 	std::string path;
 	std::string name;
-	uint32_t size;
+	uint64_t size;
 	uint32_t checksum;
-	uint32_t startPos;
-	uint32_t endPos;
+	uint64_t startPos;
+	uint64_t endPos;
+	uint32_t blobChecksum = 0; //checksum of the compressed file (FLAG_SECTION_CHECKSUMS only)
+};
+
+/// <summary>
+/// Positions of the parts of an archive describing its files
+/// (archives with a footer have them after the files, the rest in front of them)
+/// </summary>
+struct archiveLayout {
+	uint64_t pathsPos = 0; //size of the paths string, the code and the compressed paths follow it
+	uint64_t pathsEnd = 0;
+	uint64_t indexPos = 0; //the files count, the metadata of every file and the checksums of the compressed files
+	uint64_t metaChecksumPos = 0; //FLAG_SECTION_CHECKSUMS only
+	uint64_t trailerPos = 0; //FLAG_FOOTER only
+};
+
+/// <summary>
+/// Destination of an extracted file: large files are decoded straight into their memory mapping,
+/// the rest are decoded into the output buffer and written to a file stream
+/// </summary>
+struct extractOutput {
+	unsigned char* mapped = nullptr; //the mapped file (nullptr - the stream is used)
+	std::ofstream stream;
+
+	//writes decoded bytes to the stream (the bytes decoded into the mapping are already in place)
+	void write(const unsigned char* data, size_t count) {
+		if (!mapped)
+			stream.write((const char*)data, count);
+	}
+};
+
+/// <summary>
+/// Outcome of extracting one file
+/// </summary>
+enum class extractStatus {
+	extracted = 0,
+	corrupted, //the compressed file does not match its checksum, nothing was extracted
+	mismatch //the extracted file does not match its checksum, it was removed
 };
 
 /// <summary>
@@ -23,36 +70,87 @@ enum class commandCode {
 	update
 };
 
+/// <summary>
+/// Decodes files of archives. A decoder serves one request at a time (it holds the state of the file being decoded),
+/// any number of decoders may read the same Archive at the same time
+/// </summary>
 class Decoder {
+	friend class Archive; //parses the archive with a decoder once
 	size_t treeDepth = 0;
-	bitVector rawBits;
+	bitReader readers[STREAMS_CNT]; //inputs of the table decoder, the first one is used for single streams
+	uint16_t formatVersion = FORMAT_LEGACY; //version of the archive being read
+	uint16_t formatFlags = 0;
+	uint32_t blockSize = 0; //size of the blocks large files are split into (FLAG_BLOCKS only)
+	uint32_t threadsCnt = std::max(1u, std::thread::hardware_concurrency()); //threads decoding the blocks of a file
+	uint32_t headerSize = 0; //size of the archive header (legacy archives have none)
+	bool multiSymbol = true; //whether large files may be decoded with the multi-symbol table
+	uint32_t outputBuffSize = DEFAULT_OUTPUT_BUFF_SIZE;
+	bool mappedOutput = true; //whether large files are decoded straight into their memory-mapped destination
 public:
 	//exctracts one or more files from an archive
 	bool decode(const std::string& srcPath, const std::string& destPath, commandCode code = commandCode::extract, const std::string& fileName = "", Encoder* enc = nullptr);
+	//extracts one file from an archive opened once and shared by several threads (every thread needs its own decoder)
+	bool extractOne(const Archive& archive, const std::string& fileName, const std::string& destPath);
+	//decompresses a stream written by Encoder::encodeStream (e.g. from a pipe) reading and writing it only once
+	bool decodeStream(std::istream& srcStream, std::ostream& destStream);
 	//checks if file has been corrupted
 	bool checkIntegrity(const std::string& srcPath);
+	//enables decoding several symbols per lookup for low-entropy files
+	void setMultiSymbol(bool enabled);
+	//sets how many blocks of a file are decoded at the same time, returns false for 0
+	bool setThreads(uint32_t count);
+	//sets how many decoded bytes are written at once, returns false if it is out of the allowed range
+	bool setOutputBufferSize(uint32_t size);
+	//enables decoding large files straight into their memory-mapped destination
+	void setMappedOutput(bool enabled);
 private:
 	void printInfo(const std::vector<fileInfo>& files) const;
-	void readMetaData(std::ifstream& inFile, std::vector<fileInfo>& files);
-	void extractFiles(const std::vector<fileInfo>& files, std::ifstream& inFile, const std::string& destPath);
+	//compares the whole mapped archive with its trailing checksum
+	bool checkArchive(const mappedFile& archive);
+	bool readMetaData(archiveCursor& inFile, std::vector<fileInfo>& files, archiveLayout& layout);
+	//finds the paths and the metadata of the files, throws if they are not inside the archive
+	void readLayout(archiveCursor& inFile, archiveLayout& layout);
+	//reads sizes or positions written in the width of the archive (Encoder::positionSize)
+	bool readPositions(archiveCursor& inFile, uint64_t* values, size_t count);
+	bool checkMetadata(archiveCursor& inFile, const archiveLayout& layout);
+	bool checkFile(const mappedFile& archive, const fileInfo& file);
+	//checksum of the bytes [start, start + count) of the archive, read a part at a time
+	uint32_t getRegionChecksum(const mappedFile& archive, uint64_t start, uint64_t count);
+	//takes the format of an opened archive
+	void useArchive(const Archive& archive);
+	bool extractFiles(const Archive& archive, const std::string& destPath);
+	//whether a file is extracted on its own, with its blocks decoded on all the threads
+	bool extractedAlone(const fileInfo& file) const;
+	//copies the format of the archive and the settings to a decoder running on another thread
+	void setupWorker(Decoder& worker, uint32_t threads) const;
 	void setupFilePath(const std::string& filePath, std::string& fullPath);
-	void decodeFile(std::ofstream& outFile, std::ifstream& srcFile, const size_t& start, const size_t& end, const size_t& size);
-	bool extractOneFile(std::ifstream& file, const std::string& fileName, std::string destPath, const std::vector<fileInfo>& files);
-	long long binarySearchFile(const std::vector<fileInfo>& files, long long left, long long right, const std::string& name);
+	bool decodeFile(extractOutput& out, archiveCursor& srcFile, const uint64_t& start, const uint64_t& end, const uint64_t& size, uint32_t& checksum);
+	extractStatus extractFile(archiveCursor& inFile, const fileInfo& file, const std::string& filePath, std::string destPath);
+	//prints what went wrong extracting a file, returns whether it has been extracted
+	bool reportStatus(const std::string& filePath, extractStatus status) const;
+	bool extractOneFile(const Archive& archive, const std::string& fileName, std::string destPath);
 	void printFileInfo(const fileInfo& file) const;
-	void updateFile(const std::string& archivedPath, std::ifstream& archivedFile, const std::string& newFilePath, const std::vector<fileInfo>& files, Encoder& enc);
-	void copyFileContents(std::ofstream& outFile, std::ifstream& archivedFile, const size_t upperBound);
-	void changeMetadata(const uint32_t index, const uint32_t newEndPos, const uint32_t newCheckSum, const uint32_t newSize,
-						const uint32_t oldEndPos, std::ifstream& inFile, std::ofstream& outFile, const std::vector<fileInfo>& files);
-
-
-	bool readTree(tree*& t, std::ifstream& file, size_t& idx, size_t& treeStorageSize);
-	void readTreeRec(tree*& t, size_t& idx);
-	unsigned char readTreeSym(size_t& idx);
-	size_t readFileChunk(std::ifstream& file, std::unique_ptr<char[]>& buffer, size_t storageSize);
-	unsigned char readSym(const tree* t, size_t& idx);
-	void decodeFilePaths(std::string& paths, const tree* t, std::ifstream& file, const size_t& storageSize, size_t& idx);
-	void ensureBitsInVector(const size_t bitsCnt, size_t& idx, std::ifstream& file, std::unique_ptr<char[]>& buffer, size_t storageSize);
+	void updateFile(const std::string& archivedPath, Archive& archive, const std::string& newFilePath, Encoder& enc);
+	void copyFileContents(std::ofstream& outFile, const mappedFile& archive, const uint64_t start, const uint64_t upperBound);
+	void changeMetadata(const uint32_t index, const uint64_t newEndPos, const uint32_t newCheckSum, const uint32_t newBlobCheckSum, const uint64_t newSize,
+						const uint64_t oldEndPos, std::ifstream& inFile, std::ofstream& outFile, const std::vector<fileInfo>& files, const archiveLayout& layout);
+
+
+	bool readTree(tree*& t, archiveCursor& file);
+	void readTreeRec(tree*& t, bitReader& reader);
+	unsigned char readTreeSym(bitReader& reader);
+	bool readCodeLengths(decodeTable& table, archiveCursor& file);
+	void readHeader(archiveCursor& inFile);
+	unsigned char readSym(const tree* t, bitReader& reader);
+	void decodeFilePaths(std::string& paths, const tree* t, archiveCursor& file, const size_t& storageSize, const uint64_t& end);
+	void decodeFilePaths(std::string& paths, const decodeTable& table, archiveCursor& file, const size_t& storageSize, const uint64_t& end);
+	void decodeSymbols(const decodeTable& table, bitReader& reader, unsigned char* out, size_t count);
+	bool decodeStreams(const decodeTable& table, extractOutput& out, archiveCursor& srcFile, const uint64_t& end, const size_t& size, uint32_t& checksum);
+	bool openStreams(archiveCursor& srcFile, const uint64_t& end, const size_t& size, size_t* counts);
+	void decodeStreamChunks(const decodeTable& table, unsigned char* const* outs, const size_t* chunks);
+	void decodeInterleaved(const decodeTable& table, unsigned char* const* outs, size_t count);
+	bool decodeBlocks(extractOutput& out, archiveCursor& srcFile, const uint64_t& end, const uint64_t& size, uint32_t& checksum);
+	bool decodeBlock(archiveCursor& srcFile, const uint64_t& start, const uint64_t& end, unsigned char* out, const size_t& size);
 	void getTreeDepth(const tree* t, size_t depth, size_t& maxDepth);
 
 };
\ No newline at end of file
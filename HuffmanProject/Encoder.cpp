@@ -10,16 +10,53 @@ bool Encoder::encode(const std::string& srcPath, const std::string& destPath) {
 	std::cout << "Encoding..." << std::endl;
 	auto begin = std::chrono::high_resolution_clock::now();
 
+	std::vector<std::string> allFiles;
+	std::string pathsStr;
+	if (!collectFiles(srcPath, allFiles, pathsStr))
+		return false;
+
+	//the archive is created only once the files are found
+	std::ofstream archiveFile(destPath, std::ios::out | std::ios::binary);
+	if (!writeArchive(allFiles, pathsStr, archiveFile.rdbuf()))
+		return false;
+	archiveFile.close();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+	std::cout << "Time measured: "<< elapsed.count() * 1e-9  << " seconds"<<std::endl;
+	return !archiveFile.fail();
+}
+
+/// <summary>
+/// Creates archive from paths of files and folders and writes it to a stream buffer,
+/// which does not need to be seekable if the archive has a footer (e.g. a pipe)
+/// </summary>
+/// <param name="srcPath">String listing files and folders</param>
+/// <param name="archive">the buffer the archive is written to</param>
+/// <returns>whether the whole archive has been written</returns>
+bool Encoder::encode(const std::string& srcPath, std::streambuf* archive) {
+	std::vector<std::string> allFiles;
+	std::string pathsStr;
+	return collectFiles(srcPath, allFiles, pathsStr) && writeArchive(allFiles, pathsStr, archive);
+}
+
+/// <summary>
+/// Finds all the files to archive and sorts them by their names
+/// </summary>
+/// <param name="srcPath">String listing files and folders</param>
+/// <param name="allFiles">full paths of the files in archive order</param>
+/// <param name="pathsStr">paths of the files inside the archive, written as metadata</param>
+/// <returns>false if some of the paths cannot be archived</returns>
+bool Encoder::collectFiles(const std::string& srcPath, std::vector<std::string>& allFiles, std::string& pathsStr) {
 	//write all file paths as compressed string metadata
 	std::vector < std::string > fullPaths;
-	std::vector < std::string > allFiles;
 	std::vector < std::string > allFilesTrimmed;
 	std::vector < std::string > allFilesNames;
 
 	formatAllPaths(srcPath, fullPaths);
 
 	uint32_t pathsSize = fullPaths.size();
-	std::string pathsStr = ""; //in this string all paths will be stored as metadata
+	pathsStr = ""; //in this string all paths will be stored as metadata
 
 	std::cout << "Contents: " << std::endl;
 	for (size_t i = 0; i < pathsSize ; i++)
@@ -43,51 +80,214 @@ bool Encoder::encode(const std::string& srcPath, const std::string& destPath) {
 	if (pathsStr.size() >= MAX_FILE_SIZE) {
 		throw std::exception("File path description was too large!");
 	}
+	return true;
+}
 
-	std::ofstream destFile(destPath, std::ios::out | std::ios::binary);
-	//at the very beggining of the file write number (later is rewritten to end position of paths metadata)
-	destFile.write((char*)&pathsSize, sizeof(pathsSize));
-	posCnt += sizeof(pathsSize);
-	
-	//encoding the string metadata using the Huffman algorithm
-	readStringFrequencies(pathsStr); //counting frequencies of each byte
-	tree* huffmanTree = buildHuffmanTree(); //building the Huffman tree
-	size_t trDpth = 0;
-	std::vector<bool> tmpVec;
-	extractCodes(huffmanTree, tmpVec, trDpth); // computing the code of every byte
-	writeCompressedStringToFile(huffmanTree, pathsStr, destFile); //writing the compressed string
-	writeEnd(destFile); //writing last remaining bytes
-	freeTree(huffmanTree); //free tree memory
-
-	destFile.seekp(0);
-	destFile.write((char*)&posCnt, sizeof(posCnt)); //write in the beginning where string metadata ends
-	destFile.seekp(posCnt);
-
-	destFile.write((char*)&filesCnt, sizeof(filesCnt)); //writing how many files are in the archive
-	posCnt += sizeof(filesCnt);
-	fileMetaPos = posCnt; //setting the position of the files metadata to the current position in file
-
-	//reserving space for size, startpos, checksum and endpos for every file in metadata
-	uint32_t dataCount = 4 * filesCnt;
-	for (size_t i = 0; i < dataCount; i++)
-		destFile.write((char*)&dataCount, sizeof(dataCount));
-	posCnt += dataCount * sizeof(dataCount);
-	
+/// <summary>
+/// Writes the archive of the collected files: the header, the metadata and the compressed files
+/// (or the files followed by the metadata in archives with a footer, then nothing is sought back)
+/// </summary>
+/// <param name="allFiles">full paths of the files in archive order</param>
+/// <param name="pathsStr">paths of the files inside the archive</param>
+/// <param name="archive">the buffer the archive is written to</param>
+/// <returns>whether the whole archive has been written</returns>
+bool Encoder::writeArchive(const std::vector<std::string>& allFiles, const std::string& pathsStr, std::streambuf* archive) {
+	uint64_t inputSize = pathsStr.size();
 	for (size_t i = 0; i < filesCnt; i++)
-	{
-		if (!writeCompressedFile(allFiles[i], destFile))
+		inputSize += fs::file_size(allFiles[i]);
+	uint16_t settingsFlags = formatFlags; //restored once the archive is written
+	formatFlags = archiveFlags(formatVersion, formatFlags, inputSize);
+
+	checksumBuf checksum(archive); //the archive checksum is kept while writing
+	std::ostream destFile(&checksum);
+	//everything up to the files checksums is written through metaFile too, it keeps the metadata checksum
+	checksumBuf metaChecksum(&checksum);
+	std::ostream metaFile(&metaChecksum);
+	bool sectionChecksums = (formatFlags & FLAG_SECTION_CHECKSUMS) != 0;
+	if (formatVersion != FORMAT_LEGACY) {
+		archiveHeader header;
+		header.version = formatVersion;
+		header.flags = formatFlags;
+		metaFile.write((char*)&header, sizeof(header));
+		posCnt += sizeof(header);
+		if (formatFlags & FLAG_BLOCKS) {
+			metaFile.write((char*)&blockSize, sizeof(blockSize));
+			posCnt += sizeof(blockSize);
+		}
+	}
+	uint32_t headerCrc = metaChecksum.checksum(); //only the header has been written yet
+	bool footer = (formatFlags & FLAG_FOOTER) != 0;
+	uint32_t reserved = 0;
+	uint64_t metaChecksumPos = 0;
+	if (!footer) {
+		uint64_t pathsEndPosPos = posCnt;
+		//at the very beggining reserve space for the end position of paths metadata (written later)
+		uint64_t pathsEndPos = 0;
+		posCnt += writePositions(&pathsEndPos, 1, metaFile);
+
+		writePaths(pathsStr, metaFile);
+
+		pathsEndPos = posCnt;
+		metaFile.seekp(pathsEndPosPos);
+		writePositions(&pathsEndPos, 1, metaFile); //write in the beginning where string metadata ends
+		metaFile.seekp(posCnt);
+
+		metaFile.write((char*)&filesCnt, sizeof(filesCnt)); //writing how many files are in the archive
+		posCnt += sizeof(filesCnt);
+		fileMetaPos = posCnt; //setting the position of the files metadata to the current position in file
+
+		//reserving space for size, startpos, checksum and endpos for every file in metadata
+		//(and for the checksums of the compressed files)
+		std::vector<uint64_t> reservedMeta(4 * (size_t)filesCnt);
+		posCnt += writePositions(reservedMeta.data(), reservedMeta.size(), metaFile);
+		if (sectionChecksums) {
+			for (size_t i = 0; i < filesCnt; i++)
+				metaFile.write((char*)&reserved, sizeof(reserved));
+			posCnt += filesCnt * sizeof(reserved);
+		}
+
+		metaChecksumPos = posCnt;
+		if (sectionChecksums) {
+			destFile.write((char*)&reserved, sizeof(reserved));
+			posCnt += sizeof(reserved);
+		}
+	}
+
+	metadata.clear();
+	metadata.reserve(4 * filesCnt);
+	blobChecksums.clear();
+	blobChecksums.reserve(filesCnt);
+	if (threadsCnt > 1 && filesCnt > 1) {
+		if (!writeCompressedFilesParallel(allFiles, destFile)) {
+			formatFlags = settingsFlags;
 			return false;
+		}
+	}
+	else {
+		for (size_t i = 0; i < filesCnt; i++)
+		{
+			if (!writeCompressedFile(allFiles[i], destFile)) {
+				formatFlags = settingsFlags;
+				return false;
+			}
+		}
 	}
 
-	destFile.close();
-	appendCheckSumToFile(destPath);
+	if (footer) {
+		//the files count, the files metadata and the paths follow the files,
+		//the metadata checksum covers the header and them (the checksums of the two ranges are combined)
+		uint64_t footerPos = posCnt;
+		checksumBuf footerChecksum(&checksum);
+		std::ostream footerFile(&footerChecksum);
+		footerFile.write((char*)&filesCnt, sizeof(filesCnt));
+		posCnt += sizeof(filesCnt);
+		posCnt += writePositions(metadata.data(), metadata.size(), footerFile);
+		if (sectionChecksums) {
+			footerFile.write((char*)blobChecksums.data(), blobChecksums.size() * sizeof(uint32_t));
+			posCnt += blobChecksums.size() * sizeof(uint32_t);
+		}
 
-	auto end = std::chrono::high_resolution_clock::now();
-	auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
-	std::cout << "Time measured: "<< elapsed.count() * 1e-9  << " seconds"<<std::endl;
+		writePaths(pathsStr, footerFile);
+		if (sectionChecksums) {
+			uint32_t crc = crc_32::combineCRC(headerCrc, footerChecksum.checksum(), posCnt - footerPos);
+			destFile.write((char*)&crc, sizeof(crc));
+			posCnt += sizeof(crc);
+		}
 
+		//the trailer: the footer position and the footer signature
+		uint32_t signature = FOOTER_SIGNATURE;
+		posCnt += writePositions(&footerPos, 1, destFile);
+		destFile.write((char*)&signature, sizeof(signature));
+		posCnt += sizeof(signature);
+	}
+	else {
+		//the files metadata is written once all files are compressed
+		metaFile.seekp(fileMetaPos);
+		writePositions(metadata.data(), metadata.size(), metaFile);
+		if (sectionChecksums) {
+			metaFile.write((char*)blobChecksums.data(), blobChecksums.size() * sizeof(uint32_t));
+			uint32_t crc = metaChecksum.checksum();
+			destFile.seekp(metaChecksumPos);
+			destFile.write((char*)&crc, sizeof(crc));
+		}
+		destFile.seekp(posCnt);
+	}
+
+	uint32_t crc = checksum.checksum();
+	destFile.write((char*)&crc, sizeof(crc));
+	destFile.flush();
+
+	formatFlags = settingsFlags;
 	clearData();
-	return true;
+	return destFile.good();
+}
+
+/// <summary>
+/// Compresses a stream of unknown length: it is read blockSize bytes at a time and every block is written
+/// with its own code behind a header with its sizes, so nothing is sought back and the decoder needs no index.
+/// The blocks are read in order and compressed on several threads, only a few of them are in memory at a time.
+/// If the input cannot be read to its end, the stream is left without its ending block so it is never taken for a complete one
+/// </summary>
+/// <param name="srcStream">input stream, read to its end</param>
+/// <param name="destStream">output stream (it does not need to be seekable)</param>
+/// <returns>false if the input could not be read or the compressed stream could not be written</returns>
+bool Encoder::encodeStream(std::istream& srcStream, std::ostream& destStream)
+{
+	struct compressedBlock {
+		std::vector<unsigned char> input;
+		std::string data;
+		uint32_t checksum = 0;
+	};
+
+	archiveHeader header;
+	header.signature = STREAM_SIGNATURE;
+	header.version = FORMAT_CANONICAL;
+	header.flags = formatFlags & FLAG_MULTI_STREAM;
+	destStream.write((char*)&header, sizeof(header));
+	destStream.write((char*)&blockSize, sizeof(blockSize));
+
+	uint32_t crc = 0; //checksum of the whole stream (of no data yet)
+	bool inputLeft = true;
+	bool written = runOrderedInput<Encoder, compressedBlock>(threadsCnt,
+		[this](Encoder& enc) {
+			enc.setFormat(FORMAT_CANONICAL, formatFlags & FLAG_MULTI_STREAM, blockSize);
+			enc.maxCodeLength = maxCodeLength;
+		},
+		[&](size_t, compressedBlock& block) {
+			if (!inputLeft)
+				return false;
+
+			block.input.resize(blockSize);
+			srcStream.read((char*)block.input.data(), blockSize);
+			block.input.resize((size_t)srcStream.gcount());
+			inputLeft = block.input.size() == blockSize && !srcStream.bad();
+			return !block.input.empty() && !srcStream.bad();
+		},
+		[](Encoder& enc, size_t, compressedBlock& block) {
+			std::ostringstream out(std::ios::out | std::ios::binary);
+			enc.compressBuffer(block.input.data(), block.input.size(), out);
+			block.data = std::move(out).str();
+			block.checksum = crc_32::getChecksum(block.input.data(), block.input.size());
+		},
+		[&](size_t, compressedBlock& block) {
+			streamBlockHeader blockHeader;
+			blockHeader.size = (uint32_t)block.input.size();
+			blockHeader.compressedSize = (uint32_t)block.data.size();
+			blockHeader.checksum = block.checksum;
+			destStream.write((char*)&blockHeader, sizeof(blockHeader));
+			destStream.write(block.data.data(), block.data.size());
+			crc = crc_32::combineCRC(crc, block.checksum, block.input.size());
+			return destStream.good();
+		});
+
+	if (!written || srcStream.bad())
+		return false;
+
+	streamBlockHeader end;
+	end.checksum = crc;
+	destStream.write((char*)&end, sizeof(end));
+	destStream.flush();
+	return destStream.good();
 }
 
 /// <summary>
@@ -97,30 +297,55 @@ bool Encoder::encode(const std::string& srcPath, const std::string& destPath) {
 /// <param name="destFile">output stream</param>
 /// <param name="srcFile">input stream of the file we read from</param>
 /// <returns>checksum of the file</returns>
-uint32_t Encoder::compressAndWrite(const std::string& srcPath, std::ofstream& destFile, std::ifstream& srcFile)
+uint32_t Encoder::compressAndWrite(const std::string& srcPath, std::ostream& destFile, std::ifstream& srcFile)
 {
+	uint64_t size = fs::file_size(srcPath);
+	if (usesBlocks(formatFlags, blockSize, size))
+		return writeBlocks(srcPath, destFile, size);
+
+	uint32_t crc = 0xFFFFFFFF; // crc checksum of the file
+	if (size <= SINGLE_READ_MAX_SIZE) {
+		//the file is read only once, the frequencies, the checksum and the code are computed from memory
+		std::unique_ptr<unsigned char[]> data(new unsigned char[size]);
+		srcFile.clear();
+		srcFile.seekg(0);
+		srcFile.read((char*)data.get(), size);
+		if ((size_t)srcFile.gcount() != size)
+			throw std::exception("Could not read the file. Cannot compress file.");
+
+		binCode.free();
+		clearFrequencies();
+		clearCodes();
+		readBufferFrequencies(data.get(), size, crc);
+		writeCompressedBuffer(data.get(), size, destFile);
+		crc ^= 0xFFFFFFFF;
+		return crc;
+	}
+
+	//larger files are read twice: once for the frequencies and once for the code
 	//clear bincode, frequencies and map
 	binCode.free();
 	clearFrequencies();
 	clearCodes();
 	//compute frequencies
 	computeFrequencies(srcPath);
-	//build tree
-	tree* t = buildHuffmanTree();
-	//extract codes
-	std::vector<bool> tempVec;
-	tempVec.reserve(CHARS_CNT);
-	size_t depth = 0;
-	extractCodes(t, tempVec, depth);
-	//write tree
-	writeTreeToFile(t, destFile);
+	//build and write the code
+	writeCodes(destFile);
 	//write file
-	uint32_t crc = writeFileToVector(srcFile, destFile);
+	srcFile.clear();
+	srcFile.seekg(0);
+	if (usesStreams(formatFlags, size)) {
+		writeStreams(destFile, size, [&](uint64_t count) {
+			writeFileToVector(srcFile, destFile, count, crc);
+		});
+	}
+	else {
+		writeFileToVector(srcFile, destFile, size, crc);
+		//write end
+		writeEnd(destFile);
+	}
 
-	//write end
-	writeEnd(destFile);
-	//free tree from memory
-	freeTree(t);
+	crc ^= 0xFFFFFFFF;
 	return crc;
 }
 
@@ -279,7 +504,8 @@ void Encoder::clearCodes()
 {
 	for (size_t i = 0; i < CHARS_CNT; i++)
 	{
-		huffmanCodes[i].clear();
+		huffmanCodes[i] = 0;
+		codeLengths[i] = 0;
 	}
 }
 
@@ -294,35 +520,74 @@ void Encoder::readFileFrequencies(const fs::path& path)
 	while (!file.eof())
 	{
 		file.read(buffer.get(), BUFF_SIZE);
-		size_t size = file.gcount();
-		for (size_t i = 0; i < size; i++)
-		{
-			freq[(unsigned char)buffer[i]]++;
-		}
+		histogram::count((const unsigned char*)buffer.get(), file.gcount(), freq);
 	}
 }
 
 //conts the frequency of each character in the string
 void Encoder::readStringFrequencies(const std::string& str)
 {
-	size_t size = str.size();
-	for (size_t i = 0; i < size; i++)
-	{
-		freq[(unsigned char)str[i]]++;
+	histogram::count((const unsigned char*)str.data(), str.size(), freq);
+}
+
+void Encoder::readBufferFrequencies(const unsigned char* data, size_t size)
+{
+	histogram::count(data, size, freq);
+}
+
+void Encoder::readBufferFrequencies(const unsigned char* data, size_t size, uint32_t& crc)
+{
+	histogram::count(data, size, freq);
+	crc_32::updateCRC(crc, data, size);
+}
+
+/// <summary>
+/// Writes sizes or positions as 64-bit numbers in archives with FLAG_LARGE and as 32-bit numbers in the rest
+/// </summary>
+/// <param name="values">the sizes or positions</param>
+/// <param name="count">how many to write</param>
+/// <param name="destFile">output stream</param>
+/// <returns>how many bytes are written</returns>
+size_t Encoder::writePositions(const uint64_t* values, size_t count, std::ostream& destFile)
+{
+	if (formatFlags & FLAG_LARGE) {
+		destFile.write((const char*)values, count * sizeof(uint64_t));
+		return count * sizeof(uint64_t);
 	}
+
+	std::vector<uint32_t> narrow(count);
+	for (size_t i = 0; i < count; i++)
+		narrow[i] = (uint32_t)values[i];
+	destFile.write((const char*)narrow.data(), count * sizeof(uint32_t));
+	return count * sizeof(uint32_t);
+}
+
+/// <summary>
+/// Encodes the paths string using the Huffman algorithm: its size, its code and the compressed string
+/// </summary>
+/// <param name="pathsStr">paths of all files</param>
+/// <param name="destFile">output stream</param>
+void Encoder::writePaths(const std::string& pathsStr, std::ostream& destFile)
+{
+	binCode.free();
+	clearFrequencies();
+	clearCodes();
+	readStringFrequencies(pathsStr); //counting frequencies of each byte
+	writeCompressedStringToFile(pathsStr, destFile); //writing the code and the compressed string
+	writeEnd(destFile); //writing last remaining bytes
 }
 
 //returns how many bytes is written during the string decoding(not all)
-void Encoder::writeCompressedStringToFile(const tree* t, const std::string& str, std::ofstream& destFile)
+void Encoder::writeCompressedStringToFile(const std::string& str, std::ostream& destFile)
 {
 	uint32_t strSize = str.size();
 	destFile.write((char*)&strSize, sizeof(strSize)); 
 	posCnt += sizeof(strSize);
-	writeTreeToFile(t, destFile);
+	writeCodes(destFile);
 	for (size_t i = 0; i < strSize; i++)
 	{
 		writeSymbolToVector(str[i]);
-		if (binCode.size() >= BOOL_VEC_CAPACITY*WRITE_DATA_SIZE - treeDepth)
+		if (binCode.full())
 			posCnt += binCode.writeToFile(destFile);
 	}
 	posCnt += binCode.writeToFile(destFile);
@@ -344,6 +609,9 @@ tree* Encoder::buildHuffmanTree()
 		}
 	}
 
+	if (pq.empty())
+		return nullptr;
+
 	//reduce to huffman tree
 	int freq1 = 0;
 	int freq2 = 0;
@@ -387,29 +655,63 @@ void Encoder::freeTree(tree* t)
 }
 
 //exctracts binary code for each byte depending on its position in the tree
-void Encoder::extractCodes(const tree* t, std::vector<bool>& tempVec, size_t& trDpth)
+//the code is packed so that the first bit of the path is its lowest bit
+void Encoder::extractCodes(const tree* t, uint64_t code, uint32_t depth)
 {
 	if (!t)
 		return;
-	
-	trDpth++;
 
 	if (isLeaf(t)) {
-		huffmanCodes[(unsigned char)t->sym] = tempVec;
-		treeDepth = std::max(treeDepth, trDpth);
+		huffmanCodes[(unsigned char)t->sym] = code;
+		codeLengths[(unsigned char)t->sym] = depth;
+		treeDepth = std::max(treeDepth, (size_t)depth);
+	}
+	else {
+		//cannot happen for files smaller than MAX_FILE_SIZE (the depth is bounded by the fibonacci numbers)
+		if (depth >= WORD_SIZE)
+			throw std::exception("Huffman code is too long to be packed. Cannot compress file.");
+		//if we turn left write 0
+		extractCodes(t->left, code, depth + 1);
+		//if we turn right write 1
+		extractCodes(t->right, code | ((uint64_t)1 << depth), depth + 1);
+	}
+
+}
+
+/// <summary>
+/// Builds the Huffman code from the counted frequencies and writes what the decoder needs to rebuild it:
+/// the tree for legacy archives or the code lengths of the canonical code
+/// </summary>
+/// <param name="destFile">output stream</param>
+void Encoder::writeCodes(std::ostream& destFile)
+{
+	if (formatVersion == FORMAT_LEGACY) {
+		tree* t = buildHuffmanTree();
+		extractCodes(t, 0, 0);
+		writeTreeToFile(t, destFile);
+		freeTree(t);
 	}
-	else { //if we turn left write 0
-		tempVec.push_back(0);
-		extractCodes(t->left, tempVec, trDpth);
-		trDpth--;
-		tempVec.pop_back();
-		//if we turn left write 1
-		tempVec.push_back(1);
-		extractCodes(t->right, tempVec, trDpth);
-		trDpth--;
-		tempVec.pop_back();
+	else {
+		canonicalCode::buildLengths(freq, maxCodeLength, codeLengths);
+		writeCodeLengths(destFile);
 	}
+}
 
+/// <summary>
+/// Writes the code lengths table and replaces the tree codes with the canonical ones
+/// </summary>
+/// <param name="destFile">output stream</param>
+void Encoder::writeCodeLengths(std::ostream& destFile)
+{
+	std::vector<unsigned char> table;
+	canonicalCode::packLengths(codeLengths, table);
+	uint16_t tableSize = table.size();
+	destFile.write((char*)&tableSize, sizeof(tableSize));
+	destFile.write((char*)table.data(), tableSize);
+	posCnt += sizeof(tableSize) + tableSize;
+
+	if (!canonicalCode::assignCodes(codeLengths, huffmanCodes))
+		throw std::exception("Code lengths do not form a prefix code. Cannot compress file.");
 }
 
 /// <summary>
@@ -419,36 +721,203 @@ void Encoder::extractCodes(const tree* t, std::vector<bool>& tempVec, size_t& tr
 /// <param name="srcPath"></param>
 /// <param name="destFile"></param>
 /// <returns></returns>
-bool Encoder::writeCompressedFile(const std::string& srcPath, std::ofstream& destFile)
+bool Encoder::writeCompressedFile(const std::string& srcPath, std::ostream& destFile)
 {
 	//read size of file
-	if (fs::file_size(srcPath) > MAX_FILE_SIZE) {
+	if (!(formatFlags & FLAG_LARGE) && fs::file_size(srcPath) > MAX_FILE_SIZE) {
 		std::cout << "Some of the specified files may be too large. File size must be less than "
 			<< (double)MAX_FILE_SIZE / (1024 * 1024 * 1024) << " GB" << std::endl;
 		return false;
 	}
-	uint32_t fileSize = fs::file_size(srcPath);
+	uint64_t fileSize = fs::file_size(srcPath);
 	//create ifstream
 	std::ifstream srcFile(srcPath, std::ios::in | std::ios::binary);
-	//write size of file
-	destFile.seekp(fileMetaPos);
-	destFile.write((char*)&fileSize, sizeof(fileSize));
-	fileMetaPos += sizeof(fileSize);
-	//write start position
-	destFile.write((char*)&posCnt, sizeof(posCnt));
-	fileMetaPos += sizeof(posCnt);
-	destFile.seekp(posCnt);
-	uint32_t crc = compressAndWrite(srcPath, destFile, srcFile);
-	//write checksum to file
-	destFile.seekp(fileMetaPos);
-	destFile.write((char*)&crc, sizeof(crc));
-	fileMetaPos += sizeof(crc);
-	destFile.write((char*)&posCnt, sizeof(posCnt));
-	fileMetaPos += sizeof(posCnt);
-	destFile.seekp(posCnt);
+	//size and start position of file
+	metadata.push_back(fileSize);
+	metadata.push_back(posCnt);
+	//the compressed file is written through its own checksum
+	checksumBuf blobChecksum(destFile.rdbuf());
+	std::ostream blobFile(&blobChecksum);
+	uint32_t crc = compressAndWrite(srcPath, blobFile, srcFile);
+	//checksum and end position of file
+	metadata.push_back(crc);
+	metadata.push_back(posCnt);
+	blobChecksums.push_back(blobChecksum.checksum());
 	return true;
 }
 
+/// <summary>
+/// Compresses the files on several threads: every worker compresses whole files with its own encoder
+/// into memory, while this thread writes them to the archive in order and collects their metadata.
+/// Files split into blocks are left to this thread, it compresses their blocks on all the threads.
+/// So are files larger than SINGLE_READ_MAX_SIZE, so no task holds more than that in memory.
+/// The archive is the same as the one written by writeCompressedFile file by file
+/// </summary>
+/// <param name="files">full paths of the files in archive order</param>
+/// <param name="destFile">archive stream positioned after the reserved metadata</param>
+/// <returns>false if some of the files is too large</returns>
+bool Encoder::writeCompressedFilesParallel(const std::vector<std::string>& files, std::ostream& destFile)
+{
+	bool success = runOrdered<Encoder, compressedFile>(files.size(), threadsCnt,
+		[this](Encoder& enc) {
+			enc.setFormat(formatVersion, formatFlags, blockSize);
+			enc.maxCodeLength = maxCodeLength;
+			enc.threadsCnt = 1;
+		},
+		[&files](Encoder& enc, size_t idx, compressedFile& result) {
+			if (!(enc.formatFlags & FLAG_LARGE) && fs::file_size(files[idx]) > MAX_FILE_SIZE) {
+				result.tooLarge = true;
+				return;
+			}
+
+			result.size = fs::file_size(files[idx]);
+			if (usesBlocks(enc.formatFlags, enc.blockSize, result.size) || result.size > SINGLE_READ_MAX_SIZE) {
+				result.byWriter = true;
+				return;
+			}
+
+			std::ifstream srcFile(files[idx], std::ios::in | std::ios::binary);
+			std::ostringstream out(std::ios::out | std::ios::binary);
+			result.checksum = enc.compressAndWrite(files[idx], out, srcFile);
+			result.data = std::move(out).str();
+			result.blobChecksum = 0xFFFFFFFF;
+			crc_32::updateCRC(result.blobChecksum, (const unsigned char*)result.data.data(), result.data.size());
+			result.blobChecksum ^= 0xFFFFFFFF;
+		},
+		[&](size_t idx, compressedFile& result) {
+			if (result.tooLarge) {
+				std::cout << "Some of the specified files may be too large. File size must be less than "
+					<< (double)MAX_FILE_SIZE / (1024 * 1024 * 1024) << " GB" << std::endl;
+				return false;
+			}
+
+			if (result.byWriter)
+				return writeCompressedFile(files[idx], destFile);
+
+			metadata.push_back(result.size);
+			metadata.push_back(posCnt);
+			destFile.write(result.data.data(), result.data.size());
+			posCnt += result.data.size();
+			metadata.push_back(result.checksum);
+			metadata.push_back(posCnt);
+			blobChecksums.push_back(result.blobChecksum);
+			return true;
+		});
+
+	return success;
+}
+
+/// <summary>
+/// Splits the file into blocks of blockSize bytes and compresses every block with its own code on several threads.
+/// The end positions of the blocks (counted from the beginning of the first block) are written in front of them,
+/// or after them in archives with a footer
+/// </summary>
+/// <param name="srcPath">string path of the file</param>
+/// <param name="destFile">output stream</param>
+/// <param name="size">size of the file</param>
+/// <returns>checksum of the file</returns>
+uint32_t Encoder::writeBlocks(const std::string& srcPath, std::ostream& destFile, uint64_t size)
+{
+	struct blockWorker {
+		Encoder enc;
+		std::ifstream file;
+	};
+
+	struct compressedBlock {
+		std::vector<unsigned char> input;
+		std::string data;
+		uint32_t checksum = 0; //checksum of the block, combined into the file's one in order
+	};
+
+	size_t blocksCnt = blocksCount(blockSize, size);
+	std::vector<uint64_t> blockEnds(blocksCnt);
+	bool tableFirst = !(formatFlags & FLAG_FOOTER);
+	std::streampos tablePos = 0;
+	if (tableFirst) {
+		tablePos = destFile.tellp();
+		posCnt += writePositions(blockEnds.data(), blocksCnt, destFile);
+	}
+	uint64_t blocksStart = posCnt;
+	uint32_t crc = 0; //checksum of the file (of no data yet), combined from the checksums of its blocks
+
+	runOrdered<blockWorker, compressedBlock>(blocksCnt, threadsCnt,
+		[this, &srcPath](blockWorker& worker) {
+			worker.enc.setFormat(formatVersion, formatFlags, blockSize);
+			worker.enc.maxCodeLength = maxCodeLength;
+			worker.file.open(srcPath, std::ios::in | std::ios::binary);
+		},
+		[this, size](blockWorker& worker, size_t idx, compressedBlock& result) {
+			uint64_t start = (uint64_t)idx * blockSize;
+			size_t count = (size_t)std::min((uint64_t)blockSize, size - start);
+			result.input.resize(count);
+			worker.file.clear();
+			worker.file.seekg((std::streamoff)start, std::ios::beg);
+			worker.file.read((char*)result.input.data(), count);
+			if ((size_t)worker.file.gcount() != count)
+				throw std::exception("Could not read the file. Cannot compress file.");
+
+			std::ostringstream out(std::ios::out | std::ios::binary);
+			worker.enc.compressBuffer(result.input.data(), count, out);
+			result.data = std::move(out).str();
+			result.checksum = 0xFFFFFFFF;
+			crc_32::updateCRC(result.checksum, result.input.data(), count);
+			result.checksum ^= 0xFFFFFFFF;
+		},
+		[&](size_t idx, compressedBlock& result) {
+			crc = crc_32::combineCRC(crc, result.checksum, result.input.size());
+			destFile.write(result.data.data(), result.data.size());
+			posCnt += result.data.size();
+			blockEnds[idx] = posCnt - blocksStart;
+			return true;
+		});
+
+	if (tableFirst) {
+		std::streampos endPos = destFile.tellp();
+		destFile.seekp(tablePos);
+		writePositions(blockEnds.data(), blocksCnt, destFile);
+		destFile.seekp(endPos);
+	}
+	else
+		posCnt += writePositions(blockEnds.data(), blocksCnt, destFile);
+	return crc;
+}
+
+/// <summary>
+/// Builds the code of a block held in memory and writes the code and the compressed block
+/// </summary>
+/// <param name="data">the block</param>
+/// <param name="size">size of the block</param>
+/// <param name="destFile">output stream</param>
+void Encoder::compressBuffer(const unsigned char* data, size_t size, std::ostream& destFile)
+{
+	binCode.free();
+	clearFrequencies();
+	clearCodes();
+	readBufferFrequencies(data, size);
+	writeCompressedBuffer(data, size, destFile);
+}
+
+/// <summary>
+/// Builds the code from the counted frequencies and writes the code and the compressed block
+/// </summary>
+/// <param name="data">the block</param>
+/// <param name="size">size of the block</param>
+/// <param name="destFile">output stream</param>
+void Encoder::writeCompressedBuffer(const unsigned char* data, size_t size, std::ostream& destFile)
+{
+	writeCodes(destFile);
+	if (usesStreams(formatFlags, size)) {
+		writeStreams(destFile, size, [&](uint64_t count) {
+			writeBufferToVector(data, (size_t)count, destFile);
+			data += count;
+		});
+	}
+	else {
+		writeBufferToVector(data, size, destFile);
+		writeEnd(destFile);
+	}
+}
+
 /// <summary>
 /// writes the tree to the bit vector (recursive)
 /// </summary>
@@ -473,7 +942,7 @@ void Encoder::writeTreeToVec(const tree* t)
 /// </summary>
 /// <param name="t">tree node</param>
 /// <param name="destFile">destination file stream</param>
-void Encoder::writeTreeToFile(const tree* t, std::ofstream& destFile)
+void Encoder::writeTreeToFile(const tree* t, std::ostream& destFile)
 {
 	//write tree to bin vector
 	writeTreeToVec(t);
@@ -500,43 +969,19 @@ void Encoder::writeTreeToFile(const tree* t, std::ofstream& destFile)
 /// <param name="sym"></param>
 void Encoder::writeSymRaw(char sym)
 {
-	std::bitset<TREE_DATA_SIZE> bits(sym);
-
-	for (size_t i = 0; i < TREE_DATA_SIZE; i++)
-	{
-		binCode.push_back(bits[i]);
-	}
+	binCode.write((unsigned char)sym, TREE_DATA_SIZE);
 }
 
 /// <summary>
-/// bitVectors writes whole 32b values to the file, so there is a little left from it as remainder
+/// bitWriter writes whole 64b words to the file, so there is a little left from it as remainder
 /// pushing zeroes untill we have full byte and write the remainder byte-by-byte
 /// </summary>
 /// <param name="file">output stream</param>
 /// <returns>how many bytes are written</returns>
-uint32_t Encoder::writeEnd(std::ofstream& file)
+uint32_t Encoder::writeEnd(std::ostream& file)
 {	
-	while (binCode.size() % BYTE_SIZE != 0) {
-		binCode.push_back(0);
-	}
-
-	uint32_t bytesCnt = binCode.size() / BYTE_SIZE;
-	uint32_t idx = 0;
-	std::bitset<BYTE_SIZE> byte;
-
-	for (size_t i = 0; i < bytesCnt; i++)
-	{
-		for (size_t j = 0; j < BYTE_SIZE; j++)
-		{
-			byte[j] = binCode[idx];
-			idx++;
-		}
-		unsigned long num = byte.to_ulong();
-		unsigned char c = static_cast<unsigned char>(num);
-		file.write((char*)&c, sizeof(c));
-		posCnt += sizeof(c);
-	}
-	
+	uint32_t bytesCnt = binCode.writeEnd(file);
+	posCnt += bytesCnt;
 	return bytesCnt;
 }
 
@@ -553,55 +998,242 @@ void Encoder::appendCheckSumToFile(const std::string& path)
 
 }
 
+void Encoder::setFormat(uint16_t version, uint16_t flags, uint32_t blockSize)
+{
+	formatVersion = version;
+	formatFlags = version == FORMAT_LEGACY ? 0 : flags;
+	this->blockSize = blockSize;
+}
+
+uint16_t Encoder::getFormat() const
+{
+	return formatVersion;
+}
+
+uint16_t Encoder::getFormatFlags() const
+{
+	return formatFlags;
+}
+
+uint32_t Encoder::getBlockSize() const
+{
+	return blockSize;
+}
+
+bool Encoder::setBlockSize(uint32_t size)
+{
+	if (size == 0) {
+		formatFlags &= ~FLAG_BLOCKS;
+		return true;
+	}
+
+	if (size < MIN_BLOCK_SIZE || size > MAX_BLOCK_SIZE)
+		return false;
+
+	formatFlags |= FLAG_BLOCKS;
+	blockSize = size;
+	return true;
+}
+
+bool Encoder::setThreads(uint32_t count)
+{
+	if (count == 0)
+		return false;
+
+	threadsCnt = count;
+	return true;
+}
+
+void Encoder::setMultiStream(bool enabled)
+{
+	if (enabled)
+		formatFlags |= FLAG_MULTI_STREAM;
+	else
+		formatFlags &= ~FLAG_MULTI_STREAM;
+}
+
+void Encoder::setSectionChecksums(bool enabled)
+{
+	if (enabled)
+		formatFlags |= FLAG_SECTION_CHECKSUMS;
+	else
+		formatFlags &= ~FLAG_SECTION_CHECKSUMS;
+}
+
+void Encoder::setFooter(bool enabled)
+{
+	if (enabled)
+		formatFlags |= FLAG_FOOTER;
+	else
+		formatFlags &= ~FLAG_FOOTER;
+}
+
+void Encoder::setLargeFiles(bool enabled)
+{
+	if (enabled)
+		formatFlags |= FLAG_LARGE;
+	else
+		formatFlags &= ~FLAG_LARGE;
+}
+
+uint64_t Encoder::streamSegment(uint64_t size)
+{
+	return (size + STREAMS_CNT - 1) / STREAMS_CNT;
+}
+
+bool Encoder::usesStreams(uint16_t flags, uint64_t size)
+{
+	return (flags & FLAG_MULTI_STREAM) && size >= MULTI_STREAM_MIN_SIZE;
+}
+
+bool Encoder::usesBlocks(uint16_t flags, uint32_t blockSize, uint64_t size)
+{
+	return (flags & FLAG_BLOCKS) && size > blockSize;
+}
+
+size_t Encoder::blocksCount(uint32_t blockSize, uint64_t size)
+{
+	return (size_t)((size + blockSize - 1) / blockSize);
+}
+
 /// <summary>
-/// Writes a symbol's huffman code into the bit vector
+/// Archives which may grow past 4 GB get 64-bit sizes and positions, their large files are split into blocks
+/// so they are compressed and extracted on all the threads
+/// </summary>
+/// <param name="version">format version of the archive</param>
+/// <param name="flags">flags set by the settings</param>
+/// <param name="inputSize">size of all the archived files and their paths</param>
+/// <returns>the flags the archive is written with</returns>
+uint16_t Encoder::archiveFlags(uint16_t version, uint16_t flags, uint64_t inputSize)
+{
+	if (version != FORMAT_LEGACY && (inputSize >= LARGE_ARCHIVE_MIN_INPUT || (flags & FLAG_LARGE)))
+		flags |= FLAG_LARGE | FLAG_BLOCKS;
+	return flags;
+}
+
+size_t Encoder::positionSize(uint16_t flags)
+{
+	return (flags & FLAG_LARGE) ? sizeof(uint64_t) : sizeof(uint32_t);
+}
+
+size_t Encoder::trailerSize(uint16_t flags)
+{
+	return positionSize(flags) + sizeof(FOOTER_SIGNATURE);
+}
+
+bool Encoder::setMaxCodeLength(uint32_t length)
+{
+	if (length < MIN_CODE_LENGTH_LIMIT || length > MAX_CODE_LENGTH_LIMIT)
+		return false;
+
+	maxCodeLength = length;
+	return true;
+}
+
+/// <summary>
+/// Writes a symbol's huffman code into the bit writer (the whole code at once)
 /// </summary>
 /// <param name="sym"></param>
 void Encoder::writeSymbolToVector(unsigned char sym)
 {
-	const size_t size = huffmanCodes[sym].size();
-	for (size_t i = 0; i < size; i++)
-	{
-		binCode.push_back(huffmanCodes[sym][i]);
-	}
+	binCode.write(huffmanCodes[sym], codeLengths[sym]);
 }
 
 /// <summary>
 /// Given input and output streams writes compressed code to bitvector
 /// (if vector is filled the data is written to the file and the vector is emptied)
 /// </summary>
-/// <param name="file">input file stream</param>
+/// <param name="file">input file stream (read from its current position)</param>
 /// <param name="destFile">output file stream</param>
-/// <returns>Crc_32 checksum of the file</returns>
-uint32_t Encoder::writeFileToVector(std::ifstream& file, std::ofstream& destFile)
+/// <param name="count">how many bytes to compress</param>
+/// <param name="crc">Crc_32 checksum updated with the compressed bytes</param>
+void Encoder::writeFileToVector(std::ifstream& file, std::ostream& destFile, uint64_t count, uint32_t& crc)
 {
-	uint32_t crc = 0xFFFFFFFF; // crc checksum of the file
 	unsigned char b = 0;
 
 	std::unique_ptr<char[]> buffer(new char[BUFF_SIZE]);
 
 	size_t bytesRead = 1;
-	file.clear();
-	file.seekg(0);
-	while (bytesRead != 0)
+	while (bytesRead != 0 && count != 0)
 	{
-		file.read(buffer.get(), BUFF_SIZE);
+		file.read(buffer.get(), (std::streamsize)std::min((uint64_t)BUFF_SIZE, count));
 		bytesRead = file.gcount();
+		count -= bytesRead;
 
 		for (size_t i = 0; i < bytesRead; i++)
 		{
 			b = (unsigned char)buffer[i];
 			writeSymbolToVector(b);
-			crc_32::updateCRC(crc, b);
 		}
+		crc_32::updateCRC(crc, (const unsigned char*)buffer.get(), bytesRead);
 
-		if (binCode.size() >= BOOL_VEC_CAPACITY*WRITE_DATA_SIZE - treeDepth) {
+		if (binCode.full()) {
 			posCnt += binCode.writeToFile(destFile);
 		}
 	}
+}
 
-	crc ^= 0xFFFFFFFF;
-	return crc;
+/// <summary>
+/// Writes the compressed code of bytes held in memory to the bit writer
+/// (flushed every BUFF_SIZE bytes at most, so the writer never grows past its reserved size)
+/// </summary>
+/// <param name="data">the bytes</param>
+/// <param name="count">how many bytes to compress</param>
+/// <param name="destFile">output file stream</param>
+void Encoder::writeBufferToVector(const unsigned char* data, size_t count, std::ostream& destFile)
+{
+	for (size_t done = 0; done < count; done += BUFF_SIZE)
+	{
+		size_t chunkSize = std::min((size_t)BUFF_SIZE, count - done);
+		for (size_t i = 0; i < chunkSize; i++)
+			writeSymbolToVector(data[done + i]);
+
+		if (binCode.full()) {
+			posCnt += binCode.writeToFile(destFile);
+		}
+	}
+}
+
+/// <summary>
+/// Splits the file into STREAMS_CNT consecutive parts and writes every part as a separate stream,
+/// so the decoder can read all of them in the same loop. The stream sizes (except the last one)
+/// are written in front of the streams as a jump table, or after them in archives with a footer
+/// </summary>
+/// <param name="destFile">output file stream</param>
+/// <param name="size">size of the file</param>
+/// <param name="writePart">compresses the next count bytes of the file</param>
+void Encoder::writeStreams(std::ostream& destFile, uint64_t size, const std::function<void(uint64_t count)>& writePart)
+{
+	uint32_t streamSizes[STREAMS_CNT - 1] = {};
+	bool tableFirst = !(formatFlags & FLAG_FOOTER);
+	std::streampos jumpTablePos = 0;
+	if (tableFirst) {
+		jumpTablePos = destFile.tellp();
+		destFile.write((char*)streamSizes, sizeof(streamSizes));
+		posCnt += sizeof(streamSizes);
+	}
+
+	uint64_t segment = streamSegment(size);
+	for (uint32_t i = 0; i < STREAMS_CNT; i++)
+	{
+		uint64_t streamStart = posCnt;
+		uint64_t count = std::min(segment, size - std::min(size, i * segment));
+		writePart(count);
+		writeEnd(destFile); //every stream begins from a whole byte
+		if (i < STREAMS_CNT - 1)
+			streamSizes[i] = (uint32_t)(posCnt - streamStart);
+	}
+
+	if (tableFirst) {
+		std::streampos endPos = destFile.tellp();
+		destFile.seekp(jumpTablePos);
+		destFile.write((char*)streamSizes, sizeof(streamSizes));
+		destFile.seekp(endPos);
+	}
+	else {
+		destFile.write((char*)streamSizes, sizeof(streamSizes));
+		posCnt += sizeof(streamSizes);
+	}
 }
 
 //ordinary move swap for strings
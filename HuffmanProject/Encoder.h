@@ -1,10 +1,15 @@
 #pragma once
 
 #include "crc32.hpp"
-#include "bitVector.h"
+#include "canonicalCode.h"
+#include "parallel.hpp"
+#include "histogram.h"
+#include "checksumBuf.h"
 #include<unordered_map>
 #include <filesystem>
 #include<queue>
+#include <iostream>
+#include <fstream>
 #include<stdexcept>
 #include <chrono>
 #include <sstream> 
@@ -20,13 +25,63 @@
 const char pathDelimeter = '?';
 const char fileDelimeter = '*';
 
-const uint32_t CHARS_CNT = 256;
 const uint32_t NUM_WRITE_SIZE = sizeof(uint32_t) * BYTE_SIZE;
 const uint32_t TREE_DATA_SIZE = sizeof(char) * BYTE_SIZE; //size of data stored in the tree (as symbol codes)
 const uint32_t MAX_TREE_SIZE = (BYTE_SIZE + 1) * CHARS_CNT + CHARS_CNT - 1; //max size of TREE in bits
 
+//archive format versions:
+const uint16_t FORMAT_LEGACY = 1; //no header, every file stores its Huffman tree
+const uint16_t FORMAT_CANONICAL = 2; //every file stores only the code lengths of its canonical Huffman code
+const uint32_t ARCHIVE_SIGNATURE = 0x41465548; //"HUFA", legacy archives begin with the paths end position instead
+
+//archive flags (versioned archives only):
+const uint16_t FLAG_MULTI_STREAM = 0x1; //large files are split into STREAMS_CNT streams which are decoded together
+const uint16_t FLAG_BLOCKS = 0x2; //files larger than a block are split into blocks with their own codes, the block size follows the header
+//the checksum of every compressed file follows the files metadata, then the checksum of everything before it
+const uint16_t FLAG_SECTION_CHECKSUMS = 0x4;
+//the metadata and the paths follow the files as a footer and every table follows the data it describes,
+//so the archive is written without seeking back
+const uint16_t FLAG_FOOTER = 0x8;
+//sizes and positions (the paths end, the files metadata, the block end positions and the footer position) are 64-bit,
+//so archives and files may be larger than 4 GB. Such archives always split large files into blocks
+const uint16_t FLAG_LARGE = 0x10;
+const uint16_t KNOWN_FLAGS = FLAG_MULTI_STREAM | FLAG_BLOCKS | FLAG_SECTION_CHECKSUMS | FLAG_FOOTER | FLAG_LARGE;
+const uint32_t FOOTER_SIGNATURE = 0x49465548; //"HUFI", ends the trailer of archives with a footer
+//archives of more input are written with FLAG_LARGE, their compressed files may take more than 4 GB (no code is longer than 2 bytes)
+const uint64_t LARGE_ARCHIVE_MIN_INPUT = MAX_FILE_SIZE / 2;
+//compressed streams (a single input of unknown length, e.g. from a pipe) begin with the archive header with this signature,
+//the block size and a sequence of blocks ended by an empty one
+const uint32_t STREAM_SIGNATURE = 0x53465548; //"HUFS"
+
+const uint32_t STREAMS_CNT = 4;
+const uint32_t MULTI_STREAM_MIN_SIZE = 64 * 1024; //smaller files are always written as a single stream
+
+const uint32_t DEFAULT_BLOCK_SIZE = 1024 * 1024;
+const uint32_t MIN_BLOCK_SIZE = 64 * 1024;
+const uint32_t MAX_BLOCK_SIZE = 64 * 1024 * 1024;
+const uint32_t SINGLE_READ_MAX_SIZE = 64 * 1024 * 1024; //files up to this size are read once and compressed from memory
+
 namespace fs = std::filesystem;
 
+/// <summary>
+/// Written at the very beginning of versioned archives
+/// </summary>
+struct archiveHeader {
+	uint32_t signature = ARCHIVE_SIGNATURE;
+	uint16_t version = FORMAT_CANONICAL;
+	uint16_t flags = 0;
+};
+
+/// <summary>
+/// Written in front of every block of a compressed stream, so the blocks are read one by one without an index.
+/// The last block is empty and holds the checksum of the whole stream
+/// </summary>
+struct streamBlockHeader {
+	uint32_t size = 0; //size of the block before compression (0 - end of the stream)
+	uint32_t compressedSize = 0; //size of the code and the compressed data which follow
+	uint32_t checksum = 0; //checksum of the block before compression
+};
+
 struct tree {
 	char sym = 0;
 	uint32_t freq = 0;
@@ -40,6 +95,18 @@ struct tree {
 	}
 };
 
+/// <summary>
+/// A file compressed by a worker thread, waiting to be written to the archive in order
+/// </summary>
+struct compressedFile {
+	std::string data; //the compressed file exactly as it is written to the archive
+	uint64_t size = 0;
+	uint32_t checksum = 0;
+	uint32_t blobChecksum = 0; //checksum of data
+	bool tooLarge = false;
+	bool byWriter = false; //left to the writer: split into blocks (compressed in parallel) or too large to be held in memory
+};
+
 struct compareTrees {
 	bool operator()(const tree* t1, const tree* t2) {
 		return t1->freq > t2->freq;
@@ -47,25 +114,74 @@ struct compareTrees {
 };
 
 class Encoder {
-	bitVector binCode;
+	bitWriter binCode;
 	uint32_t freq[CHARS_CNT];
-	std::vector<bool> huffmanCodes[CHARS_CNT];
+	uint64_t huffmanCodes[CHARS_CNT]; //codes packed with their first bit as the lowest one
+	uint32_t codeLengths[CHARS_CNT];
 
 	size_t treeDepth = 0;
 	uint32_t filesCnt = 0;
-	uint32_t posCnt = 0;
-	uint32_t fileMetaPos = 0;
+	uint64_t posCnt = 0;
+	uint64_t fileMetaPos = 0;
+	std::vector<uint64_t> metadata; //size, start position, checksum and end position of every written file
+	std::vector<uint32_t> blobChecksums; //checksums of the compressed files (FLAG_SECTION_CHECKSUMS only)
+	uint16_t formatVersion = FORMAT_CANONICAL;
+	uint16_t formatFlags = FLAG_BLOCKS | FLAG_SECTION_CHECKSUMS;
+	uint32_t blockSize = DEFAULT_BLOCK_SIZE;
+	uint32_t maxCodeLength = DEFAULT_MAX_CODE_LENGTH; //limit of the code lengths of canonical codes
+	uint32_t threadsCnt = std::max(1u, std::thread::hardware_concurrency()); //threads compressing the files or blocks
 public:
 	//creates the whole archive
 	bool encode(const std::string& srcPath, const std::string& destPath);
-	uint32_t compressAndWrite(const std::string& srcPath, std::ofstream& destFile, std::ifstream& srcFile);
+	//creates the whole archive in a stream buffer (it is only written forward if the archive has a footer)
+	bool encode(const std::string& srcPath, std::streambuf* archive);
+	//compresses an input of unknown length (e.g. a pipe) block by block, reading and writing it only once
+	bool encodeStream(std::istream& srcStream, std::ostream& destStream);
+	uint32_t compressAndWrite(const std::string& srcPath, std::ostream& destFile, std::ifstream& srcFile);
 	void appendCheckSumToFile(const std::string& path);
+	//sets the archive format version, flags and block size written from now on (legacy archives have no flags)
+	void setFormat(uint16_t version, uint16_t flags, uint32_t blockSize);
+	uint16_t getFormat() const;
+	uint16_t getFormatFlags() const;
+	uint32_t getBlockSize() const;
+	//enables splitting large files into several interleaved streams
+	void setMultiStream(bool enabled);
+	//enables separate checksums of the metadata and of every compressed file
+	void setSectionChecksums(bool enabled);
+	//enables writing the metadata after the files (the archive is written without seeking back)
+	void setFooter(bool enabled);
+	//enables 64-bit sizes and positions even for archives which surely stay under 4 GB
+	void setLargeFiles(bool enabled);
+	//sets the size of the blocks large files are split into (0 - no blocks), returns false if it is out of the allowed range
+	bool setBlockSize(uint32_t size);
+	//sets how many files are compressed at the same time (1 - one after another), returns false for 0
+	bool setThreads(uint32_t count);
+	//sets the limit of the code lengths, returns false if it is out of the allowed range
+	bool setMaxCodeLength(uint32_t length);
 	static bool isLeaf(const tree* t);
 	static void pathStepBack(std::string& path);
 	static void freeTree(tree* t);
 	//returns the last file/directory name from a path
 	static void getFileName(const std::string& path, std::string& result);
+	//the part of a file every stream holds, the last stream may hold less
+	static uint64_t streamSegment(uint64_t size);
+	//whether a file or a block of the given size is split into STREAMS_CNT streams
+	static bool usesStreams(uint16_t flags, uint64_t size);
+	//whether a file of the given size is split into blocks
+	static bool usesBlocks(uint16_t flags, uint32_t blockSize, uint64_t size);
+	//number of blocks of a file split into blocks
+	static size_t blocksCount(uint32_t blockSize, uint64_t size);
+	//the flags of an archive of inputSize bytes (FLAG_LARGE and FLAG_BLOCKS are added to large ones)
+	static uint16_t archiveFlags(uint16_t version, uint16_t flags, uint64_t inputSize);
+	//bytes taken by a size or a position in the metadata of an archive with the given flags
+	static size_t positionSize(uint16_t flags);
+	//bytes taken by the trailer of an archive with a footer: the footer position and FOOTER_SIGNATURE
+	static size_t trailerSize(uint16_t flags);
 private:
+	//finds the files to archive (full paths in archive order) and the paths stored in the archive
+	bool collectFiles(const std::string& srcPath, std::vector<std::string>& allFiles, std::string& pathsStr);
+	//writes the header, the metadata and the compressed files
+	bool writeArchive(const std::vector<std::string>& allFiles, const std::string& pathsStr, std::streambuf* archive);
 	//gets the input string and transforms if to full file paths
 	void formatAllPaths(const std::string& str, std::vector<std::string>& result);
 	//fills two vectors with trimmed and full paths of the files
@@ -73,21 +189,42 @@ private:
 	void computeFrequencies(const std::string& path);
 	void readFileFrequencies(const fs::path& path);
 	void readStringFrequencies(const std::string& str);
-	void writeCompressedStringToFile(const tree* t, const std::string& str, std::ofstream& destFile);
+	void readBufferFrequencies(const unsigned char* data, size_t size);
+	//counts the frequencies and updates the checksum of the buffer
+	void readBufferFrequencies(const unsigned char* data, size_t size, uint32_t& crc);
+	//writes the paths of all files compressed with their own code
+	void writePaths(const std::string& pathsStr, std::ostream& destFile);
+	//writes sizes or positions in the width of the archive (positionSize), returns how many bytes are written
+	size_t writePositions(const uint64_t* values, size_t count, std::ostream& destFile);
+	void writeCompressedStringToFile(const std::string& str, std::ostream& destFile);
+	//builds the Huffman code from the frequencies and writes its description (tree or code lengths)
+	void writeCodes(std::ostream& destFile);
+	void writeCodeLengths(std::ostream& destFile);
 	tree* buildHuffmanTree();
-	void extractCodes(const tree* t, std::vector<bool>& tempVec, size_t& treeDepth);
-
-	//writes compressed file, its tree and metadata
-	bool writeCompressedFile(const std::string& srcPath, std::ofstream& destFile);
+	void extractCodes(const tree* t, uint64_t code, uint32_t depth);
+
+	//writes compressed file and its tree, collects its metadata
+	bool writeCompressedFile(const std::string& srcPath, std::ostream& destFile);
+	//compresses the files on several threads and writes them in order, collects their metadata
+	bool writeCompressedFilesParallel(const std::vector<std::string>& files, std::ostream& destFile);
+	//compresses the blocks of a file on several threads and writes them in order, returns the checksum of the file
+	uint32_t writeBlocks(const std::string& srcPath, std::ostream& destFile, uint64_t size);
+	//writes the code and the compressed data of a block held in memory
+	void compressBuffer(const unsigned char* data, size_t size, std::ostream& destFile);
+	//the same once the frequencies are counted
+	void writeCompressedBuffer(const unsigned char* data, size_t size, std::ostream& destFile);
 	void writeTreeToVec(const tree* t);
-	void writeTreeToFile(const tree* t, std::ofstream& destFile);
+	void writeTreeToFile(const tree* t, std::ostream& destFile);
 	void writeSymRaw(char sym);
-	uint32_t writeEnd(std::ofstream& file);
+	uint32_t writeEnd(std::ostream& file);
 
 
 	void writeSymbolToVector(unsigned char sym);
 
-	uint32_t writeFileToVector(std::ifstream& srCile, std::ofstream& destFile);
+	void writeFileToVector(std::ifstream& srCile, std::ostream& destFile, uint64_t count, uint32_t& crc);
+	void writeBufferToVector(const unsigned char* data, size_t count, std::ostream& destFile);
+	//writes the jump table and the streams, writePart compresses the next count bytes
+	void writeStreams(std::ostream& destFile, uint64_t size, const std::function<void(uint64_t count)>& writePart);
 
 	void moveSwap(std::string& a, std::string& b);
 	int partition(std::vector<std::string>& vec, std::vector<std::string>& vec2, std::vector<std::string>& vec3, int left, int right);
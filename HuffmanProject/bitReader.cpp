@@ -0,0 +1,28 @@
+#include "bitReader.h"
+#include <algorithm>
+
+/// <summary>
+/// Resets the reader to the beginning of a region of the mapped archive
+/// (a region which cannot be mapped is read as an empty one)
+/// </summary>
+/// <param name="file">the mapped archive</param>
+/// <param name="start">position of the first byte of the region</param>
+/// <param name="end">position after the last byte of the region</param>
+void bitReader::open(const mappedFile& file, uint64_t start, uint64_t end)
+{
+	uint64_t last = std::min(std::max(start, end), file.size());
+	uint64_t first = std::min(start, last);
+	data = last - first <= SIZE_MAX ? file.view(first, (size_t)(last - first), region) : nullptr;
+	size = data ? (size_t)(last - first) : 0;
+	pos = 0;
+	bitBuf = 0;
+	bitCnt = 0;
+}
+
+void bitReader::refillTail()
+{
+	while (bitCnt <= WORD_SIZE - BYTE_SIZE && pos < size) {
+		bitBuf |= (uint64_t)data[pos++] << bitCnt;
+		bitCnt += BYTE_SIZE;
+	}
+}
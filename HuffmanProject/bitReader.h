@@ -0,0 +1,59 @@
+#pragma once
+
+#include "bitWriter.h"
+#include "mappedFile.h"
+#include <cstring>
+
+/// <summary>
+/// Bit input engine: keeps the next bits of a stream in a 64-bit buffer (the next bit is the lowest one)
+/// and refills it directly from one region of the mapped archive (nothing is copied).
+/// Several readers may read the same mapping, every one of them from its own region
+/// </summary>
+class bitReader {
+	uint64_t bitBuf = 0;
+	uint32_t bitCnt = 0;
+	const unsigned char* data = nullptr; //the region
+	size_t pos = 0; //where the next bytes are read from
+	size_t size = 0; //end of the region
+	mappedRegion region; //the region, if the file is not mapped whole
+public:
+	//starts reading the region [start, end) of the mapped file (cut at the end of the file)
+	void open(const mappedFile& file, uint64_t start, uint64_t end);
+
+	/// <summary>
+	/// Fills the bit buffer so it holds at least 56 bits (fewer only at the end of the region).
+	/// Eight bytes are loaded at once and the position moves by the whole bytes which fitted,
+	/// the rest of the word is loaded again by the next refill (no loop, no branch on the bit count)
+	/// </summary>
+	void refill() {
+		if (size - pos < sizeof(uint64_t)) {
+			refillTail();
+			return;
+		}
+
+		uint64_t word;
+		memcpy(&word, data + pos, sizeof(word)); //little-endian: the first byte is the lowest one
+		bitBuf |= word << bitCnt;
+		pos += (WORD_SIZE - 1 - bitCnt) / BYTE_SIZE;
+		bitCnt |= WORD_SIZE - BYTE_SIZE;
+	}
+
+	//the next bits of the stream, the next one is the lowest
+	uint64_t peek() const {
+		return bitBuf;
+	}
+
+	//drops the first count bits (there must be at least count bits in the buffer)
+	void consume(const uint32_t count) {
+		bitBuf >>= count;
+		bitCnt -= count;
+	}
+
+	//number of bits in the buffer
+	uint32_t bitsLeft() const {
+		return bitCnt;
+	}
+private:
+	//adds the last bytes of the region one by one
+	void refillTail();
+};
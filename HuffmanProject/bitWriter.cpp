@@ -0,0 +1,52 @@
+#include "bitWriter.h"
+
+bitWriter::bitWriter()
+{
+	//a whole input buffer may be encoded after the writer is full, so leave room for it
+	words.reserve(WRITER_CAPACITY + BUFF_SIZE);
+}
+
+void bitWriter::push_back(const bool bit)
+{
+	write(bit, 1);
+}
+
+size_t bitWriter::size() const
+{
+	return words.size() * WORD_SIZE + accBits;
+}
+
+bool bitWriter::full() const
+{
+	return words.size() >= WRITER_CAPACITY;
+}
+
+uint32_t bitWriter::writeToFile(std::ostream& file)
+{
+	uint32_t bytesCnt = words.size() * sizeof(uint64_t);
+	file.write(reinterpret_cast<const char*>(words.data()), bytesCnt);
+	words.clear();
+	return bytesCnt;
+}
+
+uint32_t bitWriter::writeEnd(std::ostream& file)
+{
+	uint32_t bytesCnt = writeToFile(file);
+	uint32_t tailBytes = (accBits + BYTE_SIZE - 1) / BYTE_SIZE;
+	//the accumulator is filled from its lowest bit, so its first bytes are the ones needed
+	for (uint32_t i = 0; i < tailBytes; i++)
+	{
+		unsigned char c = static_cast<unsigned char>(acc >> (i * BYTE_SIZE));
+		file.write((char*)&c, sizeof(c));
+	}
+	acc = 0;
+	accBits = 0;
+	return bytesCnt + tailBytes;
+}
+
+void bitWriter::free()
+{
+	words.clear();
+	acc = 0;
+	accBits = 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "crc32.hpp"
+#include <vector>
+#include <ostream>
+
+const uint32_t BYTE_SIZE = 8; //byte size in bits
+const uint32_t WORD_SIZE = sizeof(uint64_t) * BYTE_SIZE; //size of the accumulator in bits
+const uint32_t WRITER_CAPACITY = 64 * 1024; //words kept in the output buffer before it has to be flushed (512KB)
+
+/// <summary>
+/// Bit output engine: appends whole (code, length) pairs to a 64-bit accumulator
+/// and moves every filled word into a large output buffer which is written to a file at once
+/// </summary>
+class bitWriter {
+	std::vector<uint64_t> words;
+	uint64_t acc = 0; //bits which do not form a whole word yet
+	uint32_t accBits = 0;
+public:
+	//constructor reserves the whole output buffer in order to avoid reallocations in the hot loop
+	bitWriter();
+
+	/// <summary>
+	/// Appends the lowest length bits of code, the lowest bit is written first.
+	/// Defined here so it gets inlined into the encoding loops
+	/// </summary>
+	/// <param name="code">packed code, bits above length must be zero</param>
+	/// <param name="length">number of bits (up to 64)</param>
+	void write(const uint64_t code, const uint32_t length) {
+		acc |= code << accBits;
+		accBits += length;
+		if (accBits >= WORD_SIZE) {
+			words.push_back(acc);
+			accBits -= WORD_SIZE;
+			//the bits which did not fit into the full word
+			acc = accBits ? code >> (length - accBits) : 0;
+		}
+	}
+
+	//operation push_back writes a single bit
+	void push_back(const bool bit);
+	//number of bits written and not flushed yet
+	size_t size() const;
+	//whether the output buffer has reached its capacity and should be flushed
+	bool full() const;
+	//writes all whole words to the file, returns how many bytes are written
+	uint32_t writeToFile(std::ostream& file);
+	//pads the remaining bits to a whole byte and writes everything, returns how many bytes are written
+	uint32_t writeEnd(std::ostream& file);
+	//frees all the bits in the writer
+	void free();
+};
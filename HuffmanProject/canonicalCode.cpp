@@ -0,0 +1,359 @@
+#include "canonicalCode.h"
+#include <algorithm>
+
+/// <summary>
+/// Appends bits to a byte vector (used for the small code lengths table only)
+/// </summary>
+static void putBits(std::vector<unsigned char>& result, uint64_t& acc, uint32_t& accBits, uint32_t value, uint32_t bitsCnt)
+{
+	acc |= (uint64_t)value << accBits;
+	accBits += bitsCnt;
+	while (accBits >= BYTE_SIZE) {
+		result.push_back(static_cast<unsigned char>(acc));
+		acc >>= BYTE_SIZE;
+		accBits -= BYTE_SIZE;
+	}
+}
+
+/// <summary>
+/// Reads bits from a byte array (used for the small code lengths table only)
+/// </summary>
+/// <returns>false if there are not enough bits left</returns>
+static bool getBits(const unsigned char* data, size_t size, size_t& bitIdx, uint32_t bitsCnt, uint32_t& value)
+{
+	if (bitIdx + bitsCnt > size * BYTE_SIZE)
+		return false;
+
+	value = 0;
+	for (uint32_t i = 0; i < bitsCnt; i++)
+	{
+		value |= (uint32_t)((data[bitIdx / BYTE_SIZE] >> (bitIdx % BYTE_SIZE)) & 1) << i;
+		bitIdx++;
+	}
+	return true;
+}
+
+/// <summary>
+/// Sorts the used symbols by frequency once, builds the Huffman code over them and falls back
+/// to the length-limited builder only if some code is longer than maxLength.
+/// Works on fixed-size arrays only, nothing is allocated
+/// </summary>
+/// <param name="freq">frequency of every symbol</param>
+/// <param name="maxLength">maximum code length (2^maxLength must be at least the number of symbols)</param>
+/// <param name="lengths">resulting code lengths (0 - symbol not used)</param>
+void canonicalCode::buildLengths(const uint32_t* freq, uint32_t maxLength, uint32_t* lengths)
+{
+	uint32_t leaves[CHARS_CNT]; //used symbols sorted by frequency
+	uint32_t leavesCnt = 0;
+	for (uint32_t i = 0; i < CHARS_CNT; i++)
+	{
+		lengths[i] = 0;
+		if (freq[i] != 0)
+			leaves[leavesCnt++] = i;
+	}
+
+	if (leavesCnt <= 1) {
+		//a lone symbol still needs a length to be stored (it is coded with zero bits though)
+		if (leavesCnt == 1)
+			lengths[leaves[0]] = 1;
+		return;
+	}
+
+	//equal frequencies keep the order of the symbols
+	std::sort(leaves, leaves + leavesCnt, [freq](uint32_t a, uint32_t b) {
+		return freq[a] < freq[b] || (freq[a] == freq[b] && a < b);
+	});
+
+	if (huffmanLengths(freq, leaves, leavesCnt, lengths) > maxLength)
+		limitedLengths(freq, leaves, leavesCnt, std::min(maxLength, MAX_CODE_LENGTH_LIMIT), lengths);
+}
+
+/// <summary>
+/// Two-queue Huffman: the leaves are already sorted and the merged nodes are created in order
+/// of their weights, so the two lightest nodes are always at the fronts of the two queues.
+/// Node i &lt; leavesCnt is leaf i, the merged nodes follow them
+/// </summary>
+/// <param name="freq">frequency of every symbol</param>
+/// <param name="leaves">used symbols sorted by frequency</param>
+/// <param name="leavesCnt">number of used symbols (at least 2)</param>
+/// <param name="lengths">resulting code lengths</param>
+/// <returns>the longest code length</returns>
+uint32_t canonicalCode::huffmanLengths(const uint32_t* freq, const uint32_t* leaves, uint32_t leavesCnt, uint32_t* lengths)
+{
+	uint64_t weights[2 * CHARS_CNT];
+	uint16_t parents[2 * CHARS_CNT];
+	uint32_t depths[2 * CHARS_CNT];
+	for (uint32_t i = 0; i < leavesCnt; i++)
+		weights[i] = freq[leaves[i]];
+
+	uint32_t nodesCnt = 2 * leavesCnt - 1;
+	uint32_t leafIdx = 0;
+	uint32_t mergedIdx = leavesCnt;
+	for (uint32_t node = leavesCnt; node < nodesCnt; node++)
+	{
+		weights[node] = 0;
+		for (uint32_t child = 0; child < 2; child++)
+		{
+			//on equal weights the leaf is taken first, it keeps the codes shorter
+			bool takeLeaf = leafIdx < leavesCnt && (mergedIdx == node || weights[leafIdx] <= weights[mergedIdx]);
+			uint32_t lightest = takeLeaf ? leafIdx++ : mergedIdx++;
+			parents[lightest] = node;
+			weights[node] += weights[lightest];
+		}
+	}
+
+	//parents are always created after their children, so one backward pass gives all depths
+	uint32_t maxDepth = 0;
+	depths[nodesCnt - 1] = 0;
+	for (uint32_t node = nodesCnt - 1; node-- > 0;)
+	{
+		depths[node] = depths[parents[node]] + 1;
+		if (node < leavesCnt) {
+			lengths[leaves[node]] = depths[node];
+			maxDepth = std::max(maxDepth, depths[node]);
+		}
+	}
+
+	return maxDepth;
+}
+
+/// <summary>
+/// Package-merge: at every level the symbols (sorted by frequency) are merged with the pairs ("packages")
+/// of the previous level. The 2n-2 cheapest items of the last level are selected, every selected package
+/// selects its two items from the level below and each time a symbol is selected its code gets one bit longer.
+/// Gives the optimal code with no code longer than maxLength
+/// </summary>
+/// <param name="freq">frequency of every symbol</param>
+/// <param name="leaves">used symbols sorted by frequency</param>
+/// <param name="leavesCnt">number of used symbols (at least 2)</param>
+/// <param name="maxLength">maximum code length, at most MAX_CODE_LENGTH_LIMIT</param>
+/// <param name="lengths">resulting code lengths</param>
+void canonicalCode::limitedLengths(const uint32_t* freq, const uint32_t* leaves, uint32_t leavesCnt, uint32_t maxLength, uint32_t* lengths)
+{
+	//items of every level: index of a leaf or -1 for a package (a level has less than 2n items)
+	int16_t levels[MAX_CODE_LENGTH_LIMIT][2 * CHARS_CNT];
+	uint64_t weights[2 * CHARS_CNT]; //weights of the items of the previous level
+	uint64_t merged[2 * CHARS_CNT];
+	uint32_t weightsCnt = leavesCnt;
+	for (uint32_t i = 0; i < leavesCnt; i++)
+	{
+		lengths[leaves[i]] = 0;
+		levels[0][i] = (int16_t)i;
+		weights[i] = freq[leaves[i]];
+	}
+
+	for (uint32_t level = 1; level < maxLength; level++)
+	{
+		uint32_t packagesCnt = weightsCnt / 2;
+		uint32_t leafIdx = 0;
+		uint32_t packageIdx = 0;
+		uint32_t mergedCnt = 0;
+		while (leafIdx < leavesCnt || packageIdx < packagesCnt)
+		{
+			uint64_t packageWeight = packageIdx < packagesCnt ? weights[2 * packageIdx] + weights[2 * packageIdx + 1] : 0;
+			if (packageIdx == packagesCnt || (leafIdx < leavesCnt && freq[leaves[leafIdx]] <= packageWeight)) {
+				levels[level][mergedCnt] = (int16_t)leafIdx;
+				merged[mergedCnt++] = freq[leaves[leafIdx]];
+				leafIdx++;
+			}
+			else {
+				levels[level][mergedCnt] = -1;
+				merged[mergedCnt++] = packageWeight;
+				packageIdx++;
+			}
+		}
+		std::copy(merged, merged + mergedCnt, weights);
+		weightsCnt = mergedCnt;
+	}
+
+	uint32_t selected = 2 * leavesCnt - 2;
+	for (uint32_t level = maxLength; level > 0; level--)
+	{
+		uint32_t packagesCnt = 0;
+		for (uint32_t i = 0; i < selected; i++)
+		{
+			int item = levels[level - 1][i];
+			if (item >= 0)
+				lengths[leaves[item]]++;
+			else
+				packagesCnt++;
+		}
+		selected = 2 * packagesCnt;
+	}
+}
+
+/// <summary>
+/// Assigns consecutive codes to the symbols in order of code length, then of value
+/// </summary>
+/// <param name="lengths">code length of every symbol, a lone symbol's length is set to 0</param>
+/// <param name="codes">resulting codes, packed with their first bit as the lowest one</param>
+/// <returns>whether the lengths form a complete prefix code</returns>
+bool canonicalCode::assignCodes(uint32_t* lengths, uint64_t* codes)
+{
+	uint32_t counts[MAX_CODE_LENGTH + 1];
+	uint32_t symbolsCnt = 0;
+	if (!countLengths(lengths, counts, symbolsCnt))
+		return false;
+
+	for (uint32_t i = 0; i < CHARS_CNT; i++)
+	{
+		codes[i] = 0;
+		if (symbolsCnt == 1)
+			lengths[i] = 0;
+	}
+
+	uint64_t nextCode[MAX_CODE_LENGTH + 1];
+	uint64_t code = 0;
+	for (uint32_t len = 1; len <= MAX_CODE_LENGTH; len++)
+	{
+		code = (code + counts[len - 1]) << 1;
+		nextCode[len] = code;
+	}
+
+	for (uint32_t i = 0; i < CHARS_CNT; i++)
+	{
+		if (lengths[i] != 0)
+			codes[i] = reverseBits(nextCode[lengths[i]]++, lengths[i]);
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Stores the lengths as: one byte with the number of bits per length,
+/// then for every symbol either 0 + its length or 1 + the size of a run of unused symbols
+/// </summary>
+/// <param name="lengths">code length of every symbol (0 - not used)</param>
+/// <param name="result">the stored table</param>
+void canonicalCode::packLengths(const uint32_t* lengths, std::vector<unsigned char>& result)
+{
+	uint32_t maxLength = 0;
+	for (uint32_t i = 0; i < CHARS_CNT; i++)
+		maxLength = std::max(maxLength, lengths[i]);
+
+	uint32_t lenBits = 0;
+	while (((uint32_t)1 << lenBits) <= maxLength)
+		lenBits++;
+
+	result.clear();
+	result.push_back((unsigned char)lenBits);
+
+	uint64_t acc = 0;
+	uint32_t accBits = 0;
+	uint32_t i = 0;
+	while (i < CHARS_CNT)
+	{
+		uint32_t run = 0;
+		while (i + run < CHARS_CNT && lengths[i + run] == 0 && run < (1 << LENGTH_RUN_BITS))
+			run++;
+
+		//runs are used only when they are shorter than writing the zeroes one by one
+		if (run * (1 + lenBits) > 1 + LENGTH_RUN_BITS) {
+			putBits(result, acc, accBits, 1, 1);
+			putBits(result, acc, accBits, run - 1, LENGTH_RUN_BITS);
+			i += run;
+		}
+		else {
+			putBits(result, acc, accBits, 0, 1);
+			putBits(result, acc, accBits, lengths[i], lenBits);
+			i++;
+		}
+	}
+
+	if (accBits > 0)
+		result.push_back(static_cast<unsigned char>(acc));
+}
+
+/// <summary>
+/// Reads a table written by packLengths
+/// </summary>
+/// <param name="data">the stored table</param>
+/// <param name="size">size of the table in bytes</param>
+/// <param name="lengths">code length of every symbol (0 - not used)</param>
+/// <returns>whether the table is valid</returns>
+bool canonicalCode::unpackLengths(const unsigned char* data, size_t size, uint32_t* lengths)
+{
+	if (size == 0)
+		return false;
+
+	//lengths up to MAX_CODE_LENGTH need less than a byte
+	uint32_t lenBits = data[0];
+	if (lenBits >= BYTE_SIZE)
+		return false;
+
+	size_t bitIdx = BYTE_SIZE;
+	uint32_t i = 0;
+	uint32_t value = 0;
+	while (i < CHARS_CNT)
+	{
+		if (!getBits(data, size, bitIdx, 1, value))
+			return false;
+
+		if (value == 1) {
+			if (!getBits(data, size, bitIdx, LENGTH_RUN_BITS, value) || i + value + 1 > CHARS_CNT)
+				return false;
+
+			for (uint32_t j = 0; j <= value; j++)
+				lengths[i++] = 0;
+		}
+		else {
+			if (!getBits(data, size, bitIdx, lenBits, value) || value > MAX_CODE_LENGTH)
+				return false;
+
+			lengths[i++] = value;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Counts the codes of every length and checks the lengths describe a complete prefix code
+/// (a single symbol or no symbols at all are allowed too)
+/// </summary>
+bool canonicalCode::countLengths(const uint32_t* lengths, uint32_t* counts, uint32_t& symbolsCnt)
+{
+	for (uint32_t len = 0; len <= MAX_CODE_LENGTH; len++)
+		counts[len] = 0;
+
+	symbolsCnt = 0;
+	for (uint32_t i = 0; i < CHARS_CNT; i++)
+	{
+		if (lengths[i] > MAX_CODE_LENGTH)
+			return false;
+
+		if (lengths[i] != 0) {
+			counts[lengths[i]]++;
+			symbolsCnt++;
+		}
+	}
+
+	if (symbolsCnt <= 1)
+		return true;
+
+	//number of codes still free at the current length, once it exceeds the symbols count it cannot reach 0
+	uint64_t left = 1;
+	for (uint32_t len = 1; len <= MAX_CODE_LENGTH; len++)
+	{
+		left <<= 1;
+		if (left < counts[len])
+			return false;
+
+		left -= counts[len];
+		if (left > CHARS_CNT)
+			return false;
+	}
+
+	return left == 0;
+}
+
+uint64_t canonicalCode::reverseBits(uint64_t code, uint32_t length)
+{
+	uint64_t result = 0;
+	for (uint32_t i = 0; i < length; i++)
+	{
+		result = (result << 1) | (code & 1);
+		code >>= 1;
+	}
+	return result;
+}
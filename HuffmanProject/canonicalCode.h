@@ -0,0 +1,32 @@
+#pragma once
+
+#include "bitWriter.h"
+
+const uint32_t CHARS_CNT = 256;
+const uint32_t MAX_CODE_LENGTH = WORD_SIZE; //codes are packed into 64b words
+const uint32_t MIN_CODE_LENGTH_LIMIT = 8; //all 256 symbols must fit
+const uint32_t MAX_CODE_LENGTH_LIMIT = 15; //longest codes the length-limited builder produces
+const uint32_t DEFAULT_MAX_CODE_LENGTH = 12;
+const uint32_t LENGTH_RUN_BITS = 8; //bits used to store the length of a run of unused symbols
+
+/// <summary>
+/// Canonical Huffman code: the code of every symbol is derived only from the code lengths,
+/// so the lengths are all that is stored in the archive.
+/// Codes are packed with their first bit as the lowest one (the order they are written in)
+/// </summary>
+class canonicalCode {
+public:
+	//computes optimal code lengths not longer than maxLength from the symbol frequencies
+	static void buildLengths(const uint32_t* freq, uint32_t maxLength, uint32_t* lengths);
+	//computes the codes from the code lengths (a lone symbol gets its length set to 0, it needs no bits)
+	static bool assignCodes(uint32_t* lengths, uint64_t* codes);
+	//stores the code lengths in compact form (literal lengths and runs of unused symbols)
+	static void packLengths(const uint32_t* lengths, std::vector<unsigned char>& result);
+	//reads code lengths stored by packLengths, returns false if the data is not valid
+	static bool unpackLengths(const unsigned char* data, size_t size, uint32_t* lengths);
+private:
+	static uint32_t huffmanLengths(const uint32_t* freq, const uint32_t* leaves, uint32_t leavesCnt, uint32_t* lengths);
+	static void limitedLengths(const uint32_t* freq, const uint32_t* leaves, uint32_t leavesCnt, uint32_t maxLength, uint32_t* lengths);
+	static bool countLengths(const uint32_t* lengths, uint32_t* counts, uint32_t& symbolsCnt);
+	static uint64_t reverseBits(uint64_t code, uint32_t length);
+};
@@ -0,0 +1,79 @@
+#include "checksumBuf.h"
+
+checksumBuf::checksumBuf(std::streambuf* target) : target(target)
+{
+	pos_type start = target->pubseekoff(0, std::ios_base::cur, std::ios_base::out);
+	if (start != pos_type(off_type(-1)))
+		pos = end = (uint64_t)(off_type)start;
+}
+
+uint32_t checksumBuf::checksum() const
+{
+	return crc ^ 0xFFFFFFFF;
+}
+
+/// <summary>
+/// Writes the data to the target and updates the crc with it
+/// </summary>
+/// <param name="data">bytes to write</param>
+/// <param name="count">number of bytes</param>
+/// <returns>number of bytes written</returns>
+std::streamsize checksumBuf::xsputn(const char* data, std::streamsize count)
+{
+	std::streamsize written = target->sputn(data, count);
+	if (written <= 0)
+		return written;
+
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t size = (uint64_t)written;
+	if (pos > end) {
+		//the gap is filled with zeroes
+		crc = crc_32::shiftCRC(crc, pos - end);
+		end = pos;
+	}
+
+	if (pos < end) {
+		uint64_t patchSize = std::min(size, end - pos);
+		uint32_t patchCrc = 0;
+		crc_32::updateCRC(patchCrc, bytes, (size_t)patchSize);
+		crc ^= crc_32::shiftCRC(patchCrc, end - pos - patchSize);
+		bytes += patchSize;
+		size -= patchSize;
+		pos += patchSize;
+	}
+
+	crc_32::updateCRC(crc, bytes, (size_t)size);
+	pos += size;
+	end += size;
+	return written;
+}
+
+checksumBuf::int_type checksumBuf::overflow(int_type ch)
+{
+	if (traits_type::eq_int_type(ch, traits_type::eof()))
+		return traits_type::not_eof(ch);
+
+	char c = traits_type::to_char_type(ch);
+	return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+}
+
+checksumBuf::pos_type checksumBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+	pos_type result = target->pubseekoff(off, dir, which);
+	if (result != pos_type(off_type(-1)))
+		pos = (uint64_t)(off_type)result;
+	return result;
+}
+
+checksumBuf::pos_type checksumBuf::seekpos(pos_type newPos, std::ios_base::openmode which)
+{
+	pos_type result = target->pubseekpos(newPos, which);
+	if (result != pos_type(off_type(-1)))
+		pos = (uint64_t)(off_type)result;
+	return result;
+}
+
+int checksumBuf::sync()
+{
+	return target->pubsync();
+}
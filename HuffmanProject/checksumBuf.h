@@ -0,0 +1,28 @@
+#pragma once
+
+#include "crc32.hpp"
+#include <streambuf>
+
+/// <summary>
+/// Stream buffer which passes everything to another one and keeps the crc of the written data,
+/// so a file gets its checksum without being read back.
+/// Bytes written again after a seek back are patches: they must only replace zeroes
+/// (space reserved earlier), then the patch is shifted to the end of the data and xored into the crc
+/// </summary>
+class checksumBuf : public std::streambuf {
+public:
+	checksumBuf(std::streambuf* target);
+	//the crc of all bytes written so far
+	uint32_t checksum() const;
+protected:
+	std::streamsize xsputn(const char* data, std::streamsize count) override;
+	int_type overflow(int_type ch) override;
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+	int sync() override;
+private:
+	std::streambuf* target;
+	uint32_t crc = 0xFFFFFFFF; //not inverted yet
+	uint64_t pos = 0; //current write position
+	uint64_t end = 0; //size of the written data
+};
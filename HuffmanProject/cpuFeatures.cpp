@@ -0,0 +1,75 @@
+#include "cpuFeatures.h"
+#include <cstdint>
+
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef CPU_X86
+/// <summary>
+/// Executes the cpuid instruction
+/// </summary>
+/// <param name="leaf">requested information</param>
+/// <param name="regs">eax, ebx, ecx and edx</param>
+static void cpuid(uint32_t leaf, uint32_t* regs)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, (int)leaf, 0);
+	for (int i = 0; i < 4; i++)
+		regs[i] = (uint32_t)info[i];
+#else
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+//the register state components the operating system saves on context switches
+static uint64_t savedRegisters()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax = 0, edx = 0;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+#endif
+
+/// <summary>
+/// Detects the features on the first call
+/// </summary>
+const cpuFeatures& cpuFeatures::get()
+{
+	static const cpuFeatures features = []() {
+		cpuFeatures result;
+#ifdef CPU_X86
+		uint32_t regs[4] = {};
+		cpuid(0, regs);
+		uint32_t maxLeaf = regs[0];
+		if (maxLeaf < 1)
+			return result;
+
+		cpuid(1, regs);
+		result.sse2 = (regs[3] >> 26) & 1;
+		result.sse41 = (regs[2] >> 19) & 1;
+		result.pclmul = (regs[2] >> 1) & 1;
+		bool osxsave = (regs[2] >> 27) & 1;
+		bool avx = (regs[2] >> 28) & 1;
+		//the xmm and ymm registers must be saved by the operating system
+		bool ymmSaved = osxsave && (savedRegisters() & 0x6) == 0x6;
+
+		if (maxLeaf >= 7) {
+			cpuid(7, regs);
+			result.avx2 = avx && ymmSaved && ((regs[1] >> 5) & 1);
+		}
+#endif
+		return result;
+	}();
+
+	return features;
+}
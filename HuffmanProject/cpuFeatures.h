@@ -0,0 +1,30 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+
+//functions using instructions above the compiler's baseline are marked with it (MSVC needs no marking)
+#if defined(CPU_X86) && !defined(_MSC_VER)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE41_PCLMUL __attribute__((target("sse4.1,pclmul")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_SSE41_PCLMUL
+#endif
+
+/// <summary>
+/// Instruction set extensions of the processor, detected once at runtime
+/// so the fastest variant of a kernel can be chosen
+/// </summary>
+struct cpuFeatures {
+	bool sse2 = false;
+	bool sse41 = false;
+	bool pclmul = false;
+	bool avx2 = false; //only if the operating system saves the 256-bit registers too
+
+	//the features of the processor the program runs on
+	static const cpuFeatures& get();
+};
@@ -0,0 +1,236 @@
+#include "crc32.hpp"
+#include "cpuFeatures.h"
+#include <cstring>
+#include <array>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+/// <summary>
+/// Tables of the slicing kernel: slices[k][b] is the crc of byte b followed by k zero bytes,
+/// so 16 bytes are folded into the crc with 16 independent lookups
+/// </summary>
+struct crcSlices {
+	uint32_t slices[CRC_SLICES][TABLE_SIZE];
+
+	crcSlices() {
+		for (uint32_t b = 0; b < TABLE_SIZE; b++)
+			slices[0][b] = crcTable[b];
+
+		for (uint32_t k = 1; k < CRC_SLICES; k++)
+		{
+			for (uint32_t b = 0; b < TABLE_SIZE; b++)
+				slices[k][b] = (slices[k - 1][b] >> 8) ^ crcTable[slices[k - 1][b] & 0xFF];
+		}
+	}
+};
+
+static const crcSlices crcSliceTables;
+
+/// <summary>
+/// Updates the crc with a buffer: large buffers are folded with carry-less multiplication
+/// when the processor supports it, the rest goes through the slicing kernel
+/// </summary>
+/// <param name="crc">crc to update (not inverted yet)</param>
+/// <param name="data">next bytes</param>
+/// <param name="size">number of bytes</param>
+void crc_32::updateCRC(uint32_t& crc, const unsigned char* data, size_t size)
+{
+	static const bool canFold = cpuFeatures::get().pclmul && cpuFeatures::get().sse41;
+
+	if (canFold && size >= CRC_FOLD_MIN_SIZE) {
+		size_t folded = size & ~(size_t)15; //the folding kernel works on 16 byte blocks
+		crc = updateFolded(crc, data, folded);
+		data += folded;
+		size -= folded;
+	}
+
+	updateSliced(crc, data, size);
+}
+
+/// <summary>
+/// Appending zero bytes multiplies the crc polynomial by x^8 per byte (modulo the crc polynomial),
+/// so the product is computed from the powers x^(2^k) instead of processing the bytes (as zlib's crc32_combine)
+/// </summary>
+/// <param name="crc">crc to update (not inverted yet)</param>
+/// <param name="zeroBytes">number of zero bytes</param>
+/// <returns>the updated crc</returns>
+uint32_t crc_32::shiftCRC(uint32_t crc, uint64_t zeroBytes)
+{
+	//x^(2^k) modulo the polynomial, bit-reflected like the crc itself
+	static const auto powers = []() {
+		std::array<uint32_t, 64> result = {};
+		uint32_t p = (uint32_t)1 << 30; //x^1
+		for (uint32_t& power : result)
+		{
+			power = p;
+			p = multModP(p, p);
+		}
+		return result;
+	}();
+
+	uint32_t shift = (uint32_t)1 << 31; //x^0
+	uint32_t k = 3; //a byte is x^(2^3)
+	while (zeroBytes != 0)
+	{
+		if (zeroBytes & 1)
+			shift = multModP(powers[k % powers.size()], shift);
+		zeroBytes >>= 1;
+		k++;
+	}
+
+	return multModP(shift, crc);
+}
+
+/// <summary>
+/// The initial value and the final inversion cancel out in the xor of two checksums of the same length,
+/// so A + B is A shifted by the length of B xored with B
+/// </summary>
+/// <param name="crcA">checksum of the first part</param>
+/// <param name="crcB">checksum of the second part</param>
+/// <param name="sizeB">size of the second part in bytes</param>
+/// <returns>checksum of both parts</returns>
+uint32_t crc_32::combineCRC(uint32_t crcA, uint32_t crcB, uint64_t sizeB)
+{
+	return shiftCRC(crcA, sizeB) ^ crcB;
+}
+
+//product of two bit-reflected polynomials modulo the crc polynomial
+uint32_t crc_32::multModP(uint32_t a, uint32_t b)
+{
+	const uint32_t polynomialReversed = 0xEDB88320;
+	uint32_t m = (uint32_t)1 << 31;
+	uint32_t p = 0;
+	while (m != 0)
+	{
+		if (a & m)
+			p ^= b;
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ polynomialReversed : b >> 1;
+	}
+	return p;
+}
+
+/// <summary>
+/// Slicing-by-16: the crc is xored into the first 4 bytes and every byte of the step
+/// is looked up in the table of its distance from the end of the step
+/// </summary>
+void crc_32::updateSliced(uint32_t& crc, const unsigned char* data, size_t size)
+{
+	const uint32_t (*slices)[TABLE_SIZE] = crcSliceTables.slices;
+	uint32_t c = crc;
+	while (size >= CRC_SLICES)
+	{
+		uint32_t words[4];
+		memcpy(words, data, sizeof(words));
+		words[0] ^= c;
+
+		c = 0;
+		for (uint32_t w = 0; w < 4; w++)
+		{
+			const uint32_t (*slice)[TABLE_SIZE] = slices + CRC_SLICES - 4 * (w + 1);
+			c ^= slice[3][words[w] & 0xFF] ^ slice[2][(words[w] >> 8) & 0xFF] ^
+				slice[1][(words[w] >> 16) & 0xFF] ^ slice[0][words[w] >> 24];
+		}
+
+		data += CRC_SLICES;
+		size -= CRC_SLICES;
+	}
+
+	for (size_t i = 0; i < size; i++)
+		c = crcTable[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+
+	crc = c;
+}
+
+#ifdef CPU_X86
+/// <summary>
+/// Folds 4 lanes of 16 bytes with carry-less multiplication, then folds them into one lane
+/// and reduces it to the crc (Barrett reduction), as described in Intel's "Fast CRC Computation
+/// for Generic Polynomials Using PCLMULQDQ Instruction" and used by Chromium's zlib
+/// </summary>
+/// <param name="crc">crc to update (not inverted yet)</param>
+/// <param name="data">next bytes</param>
+/// <param name="size">number of bytes, a multiple of 16 and at least CRC_FOLD_MIN_SIZE</param>
+/// <returns>the updated crc</returns>
+TARGET_SSE41_PCLMUL
+uint32_t crc_32::updateFolded(uint32_t crc, const unsigned char* data, size_t size)
+{
+	//x^(4*128+32) mod P, x^(4*128-32) mod P (the 64 byte fold), then the same for 128 bits,
+	//x^64 mod P and the bit-reflected polynomial with its Barrett constant
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	__m128i x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+	__m128i x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+	__m128i x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+	__m128i x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	data += CRC_FOLD_MIN_SIZE;
+	size -= CRC_FOLD_MIN_SIZE;
+
+	while (size >= CRC_FOLD_MIN_SIZE)
+	{
+		__m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		__m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		__m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		__m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(data + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(data + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(data + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(data + 0x30)));
+
+		data += CRC_FOLD_MIN_SIZE;
+		size -= CRC_FOLD_MIN_SIZE;
+	}
+
+	//folding the 4 lanes into one
+	__m128i lanes[3] = { x2, x3, x4 };
+	for (__m128i next : lanes)
+	{
+		__m128i low = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, next), low);
+	}
+
+	//the remaining 16 byte blocks
+	while (size >= 16)
+	{
+		__m128i low = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)data)), low);
+		data += 16;
+		size -= 16;
+	}
+
+	//128 bits to 64 bits
+	__m128i x = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x);
+	x = _mm_srli_si128(x1, 4);
+	x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x);
+
+	//Barrett reduction to 32 bits
+	x = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+	x = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), poly, 0x00);
+	x1 = _mm_xor_si128(x1, x);
+
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+#else
+uint32_t crc_32::updateFolded(uint32_t crc, const unsigned char* data, size_t size)
+{
+	updateSliced(crc, data, size);
+	return crc;
+}
+#endif
@@ -1,10 +1,14 @@
 #pragma once
 
 #include<fstream>
+#include<memory>
+#include<algorithm>
 
 const uint32_t TABLE_SIZE = 256;
 const uint32_t MAX_FILE_SIZE = UINT32_MAX; //max size of file to compress
 const uint32_t BUFF_SIZE = 4 * 1024; //in bytes
+const uint32_t CRC_SLICES = 16; //bytes processed per step by the table-driven kernel
+const size_t CRC_FOLD_MIN_SIZE = 64; //smallest buffer the carry-less multiply kernel handles
 
 static uint32_t crcTable[TABLE_SIZE] = {
 	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
@@ -62,36 +66,49 @@ public:
 		crc = crcTable[b] ^ (crc >> 8);
 	}
 
+	//updates crc with the next size characters (uses the fastest kernel the processor supports)
+	static void updateCRC(uint32_t& crc, const unsigned char* data, size_t size);
+	//crc (not inverted) after zeroBytes more zero bytes, in O(log zeroBytes)
+	static uint32_t shiftCRC(uint32_t crc, uint64_t zeroBytes);
+	//checksum of A followed by B from the checksums of A and B and the size of B
+	static uint32_t combineCRC(uint32_t crcA, uint32_t crcB, uint64_t sizeB);
+
+	//checksum of a buffer held in memory
+	static uint32_t getChecksum(const unsigned char* data, size_t size) {
+		uint32_t crc = 0xFFFFFFFF;
+		updateCRC(crc, data, size);
+		return crc ^ 0xFFFFFFFF;
+	}
+
 	/// <summary>
 	/// Calculates the crc of a file
 	/// </summary>
 	/// <param name="fileIn">target input file stream</param>
 	/// <param name="size">how many bytes of the file to update</param>
 	/// <returns>A checksum</returns>
-	static uint32_t getFileChecksum(std::ifstream& fileIn, uintmax_t size = MAX_FILE_SIZE) {
-		std::unique_ptr<char[]> buffer(new char[BUFF_SIZE]);
+	static uint32_t getFileChecksum(std::ifstream& fileIn, uintmax_t size = UINTMAX_MAX) {
+		std::unique_ptr<char[]> buffer(new char[CHECKSUM_BUFF_SIZE]);
 		uint32_t crc = 0xFFFFFFFF;
-		uint32_t cnt = 0;
-		while (!fileIn.eof())
+		uintmax_t cnt = 0;
+		while (!fileIn.eof() && cnt < size)
 		{
 			fileIn.clear();
-			fileIn.read(buffer.get(), BUFF_SIZE);
+			fileIn.read(buffer.get(), (std::streamsize)std::min((uintmax_t)CHECKSUM_BUFF_SIZE, size - cnt));
 			size_t bytesCnt = fileIn.gcount();
-			for (size_t i = 0; i < bytesCnt; i++)
-			{
-				if (cnt >= size)
-					break;
-
-				updateCRC(crc, (unsigned char)buffer[i]);
-				cnt++;
-			}
-
-			if (cnt >= size)
+			if (bytesCnt == 0)
 				break;
 
+			updateCRC(crc, (const unsigned char*)buffer.get(), bytesCnt);
+			cnt += bytesCnt;
 		}
 		return crc ^ 0xFFFFFFFF;
 	}
+private:
+	static const uint32_t CHECKSUM_BUFF_SIZE = 64 * 1024; //bytes read at once by getFileChecksum
+
+	static void updateSliced(uint32_t& crc, const unsigned char* data, size_t size);
+	static uint32_t multModP(uint32_t a, uint32_t b);
+	static uint32_t updateFolded(uint32_t crc, const unsigned char* data, size_t size);
 };
 
 //https://web.mit.edu/freebsd/head/sys/libkern/crc32.c
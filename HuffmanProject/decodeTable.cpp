@@ -0,0 +1,111 @@
+#include "decodeTable.h"
+#include <algorithm>
+
+/// <summary>
+/// Fills every entry whose index begins with the code of a symbol.
+/// Codes longer than the first level get a second level table per prefix of TABLE_BITS bits
+/// </summary>
+/// <param name="lengths">code length of every symbol (0 - not used)</param>
+/// <returns>whether the lengths form a complete prefix code no longer than MAX_CODE_LENGTH_LIMIT</returns>
+bool decodeTable::build(const uint32_t* lengths)
+{
+	uint32_t codeLengths[CHARS_CNT];
+	uint64_t codes[CHARS_CNT];
+	uint32_t symbolsCnt = 0;
+	unsigned char lastSym = 0;
+
+	minLength = MAX_CODE_LENGTH;
+	maxLength = 0;
+	multiEntries.clear();
+	for (uint32_t i = 0; i < CHARS_CNT; i++)
+	{
+		codeLengths[i] = lengths[i];
+		if (lengths[i] != 0) {
+			symbolsCnt++;
+			lastSym = (unsigned char)i;
+			minLength = std::min(minLength, lengths[i]);
+			maxLength = std::max(maxLength, lengths[i]);
+		}
+	}
+
+	if (maxLength > MAX_CODE_LENGTH_LIMIT || !canonicalCode::assignCodes(codeLengths, codes))
+		return false;
+
+	//a lone symbol is coded with zero bits, every lookup resolves it
+	if (symbolsCnt <= 1)
+		maxLength = 0;
+
+	tableBits = std::min(maxLength, TABLE_BITS);
+	uint32_t subBits = maxLength - tableBits;
+	uint32_t tableSize = 1 << tableBits;
+
+	entries.clear();
+	entries.resize(tableSize, decodeEntry{ lastSym, 0, 0 });
+
+	for (uint32_t i = 0; i < CHARS_CNT; i++)
+	{
+		uint32_t length = codeLengths[i];
+		if (length == 0)
+			continue;
+
+		if (length <= tableBits) {
+			for (uint64_t idx = codes[i]; idx < tableSize; idx += (uint64_t)1 << length)
+				entries[idx] = decodeEntry{ (unsigned char)i, (unsigned char)length, 0 };
+		}
+		else {
+			uint64_t prefix = codes[i] & (tableSize - 1);
+			if (entries[prefix].next == 0) {
+				entries[prefix] = decodeEntry{ 0, (unsigned char)subBits, (uint16_t)entries.size() };
+				entries.resize(entries.size() + ((size_t)1 << subBits));
+			}
+
+			size_t base = entries[prefix].next;
+			for (uint64_t idx = codes[i] >> tableBits; idx < ((uint64_t)1 << subBits); idx += (uint64_t)1 << (length - tableBits))
+				entries[base + idx] = decodeEntry{ (unsigned char)i, (unsigned char)length, 0 };
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+/// For every possible TABLE_BITS bits decodes the codes which fit in them completely
+/// (the table is worth it only for low-entropy data where codes are short)
+/// </summary>
+/// <returns>whether the table has been built</returns>
+bool decodeTable::buildMulti()
+{
+	multiEntries.clear();
+	if (maxLength == 0 || 2 * minLength > TABLE_BITS)
+		return false;
+
+	uint32_t tableSize = 1 << TABLE_BITS;
+	multiEntries.resize(tableSize);
+	for (uint32_t i = 0; i < tableSize; i++)
+	{
+		multiEntry& multi = multiEntries[i];
+		uint64_t bits = i;
+		while (multi.count < MAX_ENTRY_SYMBOLS) {
+			const decodeEntry& entry = lookup(bits);
+			if (entry.next != 0 || multi.length + entry.length > TABLE_BITS)
+				break;
+
+			multi.syms |= (uint32_t)entry.sym << (multi.count * BYTE_SIZE);
+			multi.count++;
+			multi.length += entry.length;
+			bits >>= entry.length;
+		}
+	}
+
+	return true;
+}
+
+bool decodeTable::hasMulti() const
+{
+	return !multiEntries.empty();
+}
+
+uint32_t decodeTable::maxCodeLength() const
+{
+	return maxLength;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "canonicalCode.h"
+
+const uint32_t TABLE_BITS = 11; //bits resolved by the first table lookup (8KB table)
+const uint32_t MAX_ENTRY_SYMBOLS = sizeof(uint32_t); //symbols a multi-symbol entry can hold
+const uint32_t MULTI_SYMBOL_MIN_SIZE = 16 * 1024; //smaller files do not repay building the multi-symbol table
+
+/// <summary>
+/// One entry of the decoding table: either a resolved symbol
+/// or a link to a second level table for the codes longer than TABLE_BITS
+/// </summary>
+struct decodeEntry {
+	unsigned char sym = 0;
+	unsigned char length = 0; //code length of the symbol or number of bits indexing the second level table
+	uint16_t next = 0; //index of the second level table (0 - symbol is resolved)
+};
+
+/// <summary>
+/// Entry of the multi-symbol table: all the codes which fit completely in TABLE_BITS bits
+/// </summary>
+struct multiEntry {
+	uint32_t syms = 0; //the symbols, the first one is the lowest byte
+	unsigned char count = 0; //0 - the first code is longer than TABLE_BITS, the single-symbol table must be used
+	unsigned char length = 0; //length of all the codes
+};
+
+/// <summary>
+/// Lookup table for a canonical Huffman code: the next bits of the stream index it directly,
+/// so a symbol is resolved with one lookup (two for the long codes)
+/// </summary>
+class decodeTable {
+	std::vector<decodeEntry> entries; //first level table followed by the second level ones
+	std::vector<multiEntry> multiEntries;
+	uint32_t tableBits = 0;
+	uint32_t minLength = 0;
+	uint32_t maxLength = 0;
+public:
+	//builds the table from the code lengths, returns false if they do not form a valid code
+	bool build(const uint32_t* lengths);
+	//builds the multi-symbol table as well, returns false if no entry could hold more than one symbol
+	bool buildMulti();
+	bool hasMulti() const;
+	//length of the longest code (how many bits a single lookup may need)
+	uint32_t maxCodeLength() const;
+
+	/// <summary>
+	/// Resolves up to MAX_ENTRY_SYMBOLS symbols at the beginning of the bits at once
+	/// </summary>
+	/// <param name="bits">at least TABLE_BITS next bits of the stream</param>
+	/// <returns>entry with the symbols, their count and the length of their codes</returns>
+	const multiEntry& lookupMulti(const uint64_t bits) const {
+		return multiEntries[bits & (((uint64_t)1 << TABLE_BITS) - 1)];
+	}
+
+	/// <summary>
+	/// Resolves the symbol at the beginning of the bits (the next bit of the stream is the lowest one).
+	/// Defined here so it gets inlined into the decoding loops
+	/// </summary>
+	/// <param name="bits">at least maxCodeLength() next bits of the stream</param>
+	/// <returns>entry with the symbol and its code length</returns>
+	const decodeEntry& lookup(const uint64_t bits) const {
+		const decodeEntry& entry = entries[bits & (((uint64_t)1 << tableBits) - 1)];
+		if (entry.next == 0)
+			return entry;
+
+		return entries[entry.next + ((bits >> tableBits) & (((uint64_t)1 << entry.length) - 1))];
+	}
+};
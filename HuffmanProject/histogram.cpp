@@ -0,0 +1,113 @@
+#include "histogram.h"
+#include "cpuFeatures.h"
+#include <cstring>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+/// <summary>
+/// Counts the 8 bytes of a word, every byte into a different table than its neighbour
+/// </summary>
+static inline void countWord(uint32_t (*tables)[CHARS_CNT], uint64_t word)
+{
+	tables[0][word & 0xFF]++;
+	tables[1][(word >> 8) & 0xFF]++;
+	tables[2][(word >> 16) & 0xFF]++;
+	tables[3][(word >> 24) & 0xFF]++;
+	tables[0][(word >> 32) & 0xFF]++;
+	tables[1][(word >> 40) & 0xFF]++;
+	tables[2][(word >> 48) & 0xFF]++;
+	tables[3][word >> 56]++;
+}
+
+static inline void countWords(uint32_t (*tables)[CHARS_CNT], const unsigned char* data, size_t wordsCnt)
+{
+	for (size_t i = 0; i < wordsCnt; i++)
+	{
+		uint64_t word;
+		memcpy(&word, data + i * sizeof(word), sizeof(word));
+		countWord(tables, word);
+	}
+}
+
+//counts the bytes the vector loop has left and adds the partial tables to freq
+static void finish(uint32_t (*tables)[CHARS_CNT], const unsigned char* data, size_t size, uint32_t* freq)
+{
+	for (size_t i = 0; i < size; i++)
+		tables[i % HISTOGRAM_TABLES][data[i]]++;
+
+	for (uint32_t sym = 0; sym < CHARS_CNT; sym++)
+		freq[sym] += tables[0][sym] + tables[1][sym] + tables[2][sym] + tables[3][sym];
+}
+
+/// <summary>
+/// Chooses the kernel on the first call
+/// </summary>
+/// <param name="data">bytes to count</param>
+/// <param name="size">number of bytes</param>
+/// <param name="freq">counts of every byte, the new counts are added</param>
+void histogram::count(const unsigned char* data, size_t size, uint32_t* freq)
+{
+	static void (* const kernel)(const unsigned char*, size_t, uint32_t*) =
+		cpuFeatures::get().avx2 ? countAvx2 : cpuFeatures::get().sse2 ? countSse2 : countPortable;
+
+	kernel(data, size, freq);
+}
+
+void histogram::countPortable(const unsigned char* data, size_t size, uint32_t* freq)
+{
+	uint32_t tables[HISTOGRAM_TABLES][CHARS_CNT] = {};
+	size_t wordsCnt = size / sizeof(uint64_t);
+	countWords(tables, data, wordsCnt);
+	size_t done = wordsCnt * sizeof(uint64_t);
+	finish(tables, data + done, size - done, freq);
+}
+
+#ifdef CPU_X86
+TARGET_SSE2
+void histogram::countSse2(const unsigned char* data, size_t size, uint32_t* freq)
+{
+	const size_t vecSize = sizeof(__m128i);
+	uint32_t tables[HISTOGRAM_TABLES][CHARS_CNT] = {};
+	size_t i = 0;
+	for (; i + vecSize <= size; i += vecSize)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(data + i));
+		__m128i first = _mm_set1_epi8((char)data[i]);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, first)) == 0xFFFF)
+			tables[0][data[i]] += vecSize; //a run of one byte
+		else
+			countWords(tables, data + i, vecSize / sizeof(uint64_t));
+	}
+	finish(tables, data + i, size - i, freq);
+}
+
+TARGET_AVX2
+void histogram::countAvx2(const unsigned char* data, size_t size, uint32_t* freq)
+{
+	const size_t vecSize = sizeof(__m256i);
+	uint32_t tables[HISTOGRAM_TABLES][CHARS_CNT] = {};
+	size_t i = 0;
+	for (; i + vecSize <= size; i += vecSize)
+	{
+		__m256i bytes = _mm256_loadu_si256((const __m256i*)(data + i));
+		__m256i first = _mm256_set1_epi8((char)data[i]);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, first)) == -1)
+			tables[0][data[i]] += vecSize; //a run of one byte
+		else
+			countWords(tables, data + i, vecSize / sizeof(uint64_t));
+	}
+	finish(tables, data + i, size - i, freq);
+}
+#else
+void histogram::countSse2(const unsigned char* data, size_t size, uint32_t* freq)
+{
+	countPortable(data, size, freq);
+}
+
+void histogram::countAvx2(const unsigned char* data, size_t size, uint32_t* freq)
+{
+	countPortable(data, size, freq);
+}
+#endif
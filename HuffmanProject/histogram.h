@@ -0,0 +1,21 @@
+#pragma once
+
+#include "canonicalCode.h"
+
+const uint32_t HISTOGRAM_TABLES = 4; //partial count tables, consecutive bytes go to different tables
+
+/// <summary>
+/// Byte histogram kernels. Counting every byte into a single table stalls on runs of the same byte
+/// (every increment waits for the previous one), so the bytes are spread over several partial tables
+/// which are summed at the end. The SIMD variants also detect whole vectors of one repeated byte
+/// and count them with a single addition. The best variant is chosen at runtime
+/// </summary>
+class histogram {
+public:
+	//adds the counts of the bytes of data to freq
+	static void count(const unsigned char* data, size_t size, uint32_t* freq);
+private:
+	static void countPortable(const unsigned char* data, size_t size, uint32_t* freq);
+	static void countSse2(const unsigned char* data, size_t size, uint32_t* freq);
+	static void countAvx2(const unsigned char* data, size_t size, uint32_t* freq);
+};
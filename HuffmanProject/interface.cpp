@@ -1,7 +1,12 @@
 #include<iostream>
 #include "Encoder.h"
 #include "Decoder.h"
+#include "selfTest.h"
 #include<string>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 
 const char commandArch[] = "archive";
@@ -11,10 +16,72 @@ const char commandExctractOne[] = "one";
 const char commandInfo[] = "info";
 const char commandCheck[] = "check";
 const char commandUpdate[] = "update";
+const char commandSet[] = "set";
+const char optionMaxLength[] = "maxlength";
+const char optionMultiSymbol[] = "multisymbol";
+const char optionStreams[] = "streams";
+const char optionThreads[] = "threads";
+const char optionBlockSize[] = "blocksize";
+const char optionChecksums[] = "checksums";
+const char optionOutputBuffer[] = "outbuffer";
+const char optionMappedOutput[] = "mapoutput";
+const char optionFooter[] = "footer";
+const char optionLargeFiles[] = "largefiles";
 const char commandExit[] = "exit";
+const char argCompress[] = "-c"; //compress the standard input into the standard output
+const char argDecompress[] = "-d"; //decompress the standard input into the standard output
+const char argTest[] = "-t"; //run the self checks, the exit code tells whether they passed
 
 
-int main() {
+/// <summary>
+/// Compresses or decompresses the standard input into the standard output (e.g. tar | HuffmanProject -c | ssh ...).
+/// The standard output holds only the data, the messages go to the standard error
+/// </summary>
+/// <param name="compress">whether to compress or to decompress</param>
+/// <returns>exit code of the program</returns>
+int runStream(bool compress) {
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	std::ios::sync_with_stdio(false);
+	//the input is read on the worker threads while the output is written, a read must not flush the output
+	std::cin.tie(nullptr);
+	try {
+		bool written = false;
+		if (compress) {
+			Encoder enc;
+			written = enc.encodeStream(std::cin, std::cout);
+		}
+		else {
+			Decoder dec;
+			written = dec.decodeStream(std::cin, std::cout);
+		}
+
+		if (!written) {
+			std::cerr << (compress ? "The input could not be read or the output could not be written!" : "The output could not be written!") << std::endl;
+			return 1;
+		}
+	}
+	catch (const std::exception& ex) {
+		std::cerr << "what():  " << ex.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 1) {
+		if (strcmp(argv[1], argCompress) == 0 || strcmp(argv[1], argDecompress) == 0)
+			return runStream(strcmp(argv[1], argCompress) == 0);
+
+		if (strcmp(argv[1], argTest) == 0)
+			return selfTest::run(fs::temp_directory_path().string()) ? 0 : 1;
+
+		std::cerr << "Usage: " << argv[0] << " [" << argCompress << " | " << argDecompress << " | " << argTest << "]" << std::endl;
+		return 1;
+	}
+
 	Encoder enc;
 	Decoder dec;
 
@@ -104,6 +171,87 @@ int main() {
 					std::cout << "The file was NOT updated the right way!" << std::endl;
 				std::cout << std::endl;
 			}
+			else if (strcmp(command.c_str(), commandSet) == 0) {
+				std::string option;
+				std::cout << "Option: ";
+				std::cin >> option;
+				if (strcmp(option.c_str(), optionMaxLength) == 0) {
+					uint32_t length = 0;
+					std::cout << "Maximum code length (" << MIN_CODE_LENGTH_LIMIT << "-" << MAX_CODE_LENGTH_LIMIT << "): ";
+					std::cin >> length;
+					if (enc.setMaxCodeLength(length))
+						std::cout << "Maximum code length is set to " << length << std::endl;
+					else
+						std::cout << "Code length is out of the allowed range!" << std::endl;
+				}
+				else if (strcmp(option.c_str(), optionMultiSymbol) == 0) {
+					bool enabled = false;
+					std::cout << "Decode several symbols per lookup (1/0): ";
+					std::cin >> enabled;
+					dec.setMultiSymbol(enabled);
+				}
+				else if (strcmp(option.c_str(), optionStreams) == 0) {
+					bool enabled = false;
+					std::cout << "Split large files into " << STREAMS_CNT << " interleaved streams (1/0): ";
+					std::cin >> enabled;
+					enc.setMultiStream(enabled);
+				}
+				else if (strcmp(option.c_str(), optionThreads) == 0) {
+					uint32_t count = 0;
+					std::cout << "Files or blocks processed at the same time (1 - one after another): ";
+					std::cin >> count;
+					if (enc.setThreads(count) && dec.setThreads(count))
+						std::cout << "Files are processed on " << count << " threads" << std::endl;
+					else
+						std::cout << "At least one thread is needed!" << std::endl;
+				}
+				else if (strcmp(option.c_str(), optionBlockSize) == 0) {
+					uint32_t size = 0;
+					std::cout << "Block size in KB (" << MIN_BLOCK_SIZE / 1024 << "-" << MAX_BLOCK_SIZE / 1024 << ", 0 - no blocks): ";
+					std::cin >> size;
+					if (enc.setBlockSize(size * 1024))
+						std::cout << "Block size is set to " << size << " KB" << std::endl;
+					else
+						std::cout << "Block size is out of the allowed range!" << std::endl;
+				}
+				else if (strcmp(option.c_str(), optionChecksums) == 0) {
+					bool enabled = false;
+					std::cout << "Separate checksums of the metadata and of every file (1/0): ";
+					std::cin >> enabled;
+					enc.setSectionChecksums(enabled);
+				}
+				else if (strcmp(option.c_str(), optionOutputBuffer) == 0) {
+					uint32_t size = 0;
+					std::cout << "Extraction output buffer in KB (" << MIN_OUTPUT_BUFF_SIZE / 1024 << "-" << MAX_OUTPUT_BUFF_SIZE / 1024 << "): ";
+					std::cin >> size;
+					if (dec.setOutputBufferSize(size * 1024))
+						std::cout << "Output buffer size is set to " << size << " KB" << std::endl;
+					else
+						std::cout << "Output buffer size is out of the allowed range!" << std::endl;
+				}
+				else if (strcmp(option.c_str(), optionMappedOutput) == 0) {
+					bool enabled = false;
+					std::cout << "Decode files of at least " << MAPPED_OUTPUT_MIN_SIZE / (1024 * 1024) << " MB straight into their mapped destination (1/0): ";
+					std::cin >> enabled;
+					dec.setMappedOutput(enabled);
+				}
+				else if (strcmp(option.c_str(), optionFooter) == 0) {
+					bool enabled = false;
+					std::cout << "Write the metadata after the files, without seeking back (1/0): ";
+					std::cin >> enabled;
+					enc.setFooter(enabled);
+				}
+				else if (strcmp(option.c_str(), optionLargeFiles) == 0) {
+					bool enabled = false;
+					std::cout << "64-bit sizes and positions for every archive, not only for those over "
+						<< LARGE_ARCHIVE_MIN_INPUT / (1024 * 1024) << " MB of input (1/0): ";
+					std::cin >> enabled;
+					enc.setLargeFiles(enabled);
+				}
+				else
+					std::cout << "Unknown option!" << std::endl;
+				std::cout << std::endl;
+			}
 		}
 		catch (std::filesystem::filesystem_error const& ex) {
 			std::cout
@@ -0,0 +1,363 @@
+#include "mappedFile.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mappedFile::~mappedFile()
+{
+	close();
+}
+
+/// <summary>
+/// Gives the open file its final size, the space is allocated at once, so a full disk is reported here
+/// and not when the data is written. Only file systems which cannot allocate get a sparse file of the size instead
+/// </summary>
+/// <param name="file">the file opened for writing</param>
+/// <param name="size">size of the file</param>
+/// <returns>whether the file has its size</returns>
+#ifdef _WIN32
+static bool allocate(HANDLE file, uint64_t size)
+{
+	LARGE_INTEGER fileSize;
+	fileSize.QuadPart = (LONGLONG)size;
+	return SetFilePointerEx(file, fileSize, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+}
+#else
+static bool allocate(int fd, uint64_t size)
+{
+	int error = posix_fallocate(fd, 0, (off_t)size);
+	if (error == EINVAL || error == EOPNOTSUPP)
+		error = ftruncate(fd, (off_t)size) == 0 ? 0 : errno;
+	return error == 0;
+}
+#endif
+
+mappedRegion::~mappedRegion()
+{
+	unmap();
+}
+
+void mappedRegion::unmap()
+{
+	if (view) {
+#ifdef _WIN32
+		UnmapViewOfFile(view);
+#else
+		munmap(view, viewSize);
+#endif
+	}
+	view = nullptr;
+	viewSize = 0;
+	start = 0;
+	count = 0;
+	bytes = nullptr;
+}
+
+/// <summary>
+/// Maps the whole file read-only. If its mapping does not fit into the address space,
+/// the file stays open and its parts are mapped when they are read
+/// </summary>
+/// <param name="path">path of the file</param>
+/// <returns>whether the file has been opened</returns>
+bool mappedFile::open(const std::string& path)
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	length = (uint64_t)fileSize.QuadPart;
+	if (length == 0) //empty files cannot be mapped
+		return true;
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle) {
+		close();
+		return false;
+	}
+	if (length <= SIZE_MAX)
+		bytes = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close();
+		return false;
+	}
+
+	length = (uint64_t)info.st_size;
+	if (length == 0) //empty files cannot be mapped
+		return true;
+
+	if (length <= SIZE_MAX) {
+		void* view = mmap(nullptr, (size_t)length, PROT_READ, MAP_SHARED, fd, 0);
+		if (view != MAP_FAILED)
+			bytes = (const unsigned char*)view;
+	}
+#endif
+
+	//without bytes the file is read through regions
+	return true;
+}
+
+/// <summary>
+/// Creates the file with its final size (the space is allocated at once) and maps it for writing
+/// </summary>
+/// <param name="path">path of the file</param>
+/// <param name="size">size of the file, it must not be 0 and it must fit into the address space</param>
+/// <returns>whether the file has been created and mapped</returns>
+bool mappedFile::create(const std::string& path, uint64_t size)
+{
+	close();
+	if (size == 0 || size > SIZE_MAX)
+		return false;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	fileHandle = file;
+	length = size;
+	if (allocate(file, size)) {
+		mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+		if (mappingHandle)
+			bytes = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_WRITE, 0, 0, 0);
+	}
+#else
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+
+	length = size;
+	if (allocate(fd, size)) {
+		void* view = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (view != MAP_FAILED)
+			bytes = (const unsigned char*)view;
+	}
+#endif
+
+	if (!bytes) {
+		close();
+		return false;
+	}
+	writable = true;
+	return true;
+}
+
+/// <summary>
+/// Creates the file with its final size, so a file written through a stream gets its space at once and is not fragmented
+/// </summary>
+/// <param name="path">path of the file</param>
+/// <param name="size">size of the file</param>
+/// <returns>whether the file has been created with its size</returns>
+bool mappedFile::preallocate(const std::string& path, uint64_t size)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	bool allocated = allocate(file, size);
+	CloseHandle(file);
+#else
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+
+	bool allocated = allocate(fd, size);
+	::close(fd);
+#endif
+	return allocated;
+}
+
+/// <summary>
+/// Lets cursors and bit readers read a buffer of the caller, close only detaches it
+/// </summary>
+/// <param name="data">the buffer</param>
+/// <param name="size">size of the buffer</param>
+void mappedFile::attach(const unsigned char* data, size_t size)
+{
+	close();
+	bytes = data;
+	length = size;
+	attached = true;
+}
+
+void mappedFile::close()
+{
+	if (attached) {
+		bytes = nullptr;
+		attached = false;
+	}
+#ifdef _WIN32
+	if (bytes)
+		UnmapViewOfFile(bytes);
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle)
+		CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	if (bytes)
+		munmap((void*)bytes, (size_t)length);
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	bytes = nullptr;
+	length = 0;
+	writable = false;
+}
+
+bool mappedFile::isOpen() const
+{
+	if (attached)
+		return true;
+#ifdef _WIN32
+	return fileHandle != nullptr;
+#else
+	return fd >= 0;
+#endif
+}
+
+const unsigned char* mappedFile::data() const
+{
+	return bytes;
+}
+
+unsigned char* mappedFile::writableData()
+{
+	return writable ? (unsigned char*)bytes : nullptr;
+}
+
+uint64_t mappedFile::size() const
+{
+	return length;
+}
+
+/// <summary>
+/// Gives the bytes of a part of the file. A file mapped whole gives its own bytes, otherwise the part is mapped
+/// into the region (unless the region already has it), so the bytes stay valid until the region maps another part
+/// </summary>
+/// <param name="start">position of the first byte</param>
+/// <param name="count">number of bytes</param>
+/// <param name="region">region of the reader</param>
+/// <param name="readAhead">bytes after the part which are mapped with it (cut at the end of the file)</param>
+/// <returns>the bytes, nullptr if the part is not in the file or could not be mapped</returns>
+const unsigned char* mappedFile::view(uint64_t start, size_t count, mappedRegion& region, size_t readAhead) const
+{
+	static const unsigned char none = 0; //the bytes of an empty part
+
+	if (start > length || count > length - start)
+		return nullptr;
+	if (bytes)
+		return bytes + start;
+	if (count == 0)
+		return &none;
+	if (region.contains(start, count))
+		return region.bytes + (start - region.start);
+
+	region.unmap();
+	uint64_t mappedCount = std::min((uint64_t)count + readAhead, length - start);
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	uint64_t alignedStart = start - start % info.dwAllocationGranularity;
+#else
+	uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+	uint64_t alignedStart = start - start % pageSize;
+#endif
+	uint64_t viewSize = mappedCount + (start - alignedStart);
+	if (viewSize > SIZE_MAX)
+		return nullptr;
+
+#ifdef _WIN32
+	void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, (DWORD)(alignedStart >> 32), (DWORD)alignedStart, (size_t)viewSize);
+	if (!view)
+		return nullptr;
+#else
+	void* view = mmap(nullptr, (size_t)viewSize, PROT_READ, MAP_SHARED, fd, (off_t)alignedStart);
+	if (view == MAP_FAILED)
+		return nullptr;
+#endif
+
+	region.view = view;
+	region.viewSize = (size_t)viewSize;
+	region.start = start;
+	region.count = (size_t)mappedCount;
+	region.bytes = (const unsigned char*)view + (start - alignedStart);
+	return region.bytes;
+}
+
+/// <summary>
+/// Sequential regions are read ahead aggressively as they are read, random ones are not read ahead.
+/// Only the hint is given, no page is read now (Windows has no such hint, see prefetch)
+/// </summary>
+/// <param name="pattern">how the region is going to be read</param>
+/// <param name="start">first byte of the region</param>
+/// <param name="count">size of the region (cut at the end of the file)</param>
+void mappedFile::advise(accessPattern pattern, uint64_t start, uint64_t count) const
+{
+#ifndef _WIN32
+	if (!bytes || start >= length)
+		return;
+
+	count = std::min(count, length - start);
+	//the advised region must begin at a page boundary (a file mapped whole fits into size_t)
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t alignedStart = (size_t)start - (size_t)start % pageSize;
+	size_t alignedCount = (size_t)count + ((size_t)start - alignedStart);
+	madvise((void*)(bytes + alignedStart), alignedCount, pattern == accessPattern::sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+}
+
+/// <summary>
+/// Starts reading the beginning of a region into the page cache, the readers call it for the part they are about
+/// to read. At most PREFETCH_WINDOW bytes are requested, so a large archive is not read whole at once
+/// </summary>
+/// <param name="start">first byte of the region</param>
+/// <param name="count">size of the region (cut at the end of the file and to PREFETCH_WINDOW)</param>
+void mappedFile::prefetch(uint64_t start, uint64_t count) const
+{
+	if (!bytes || start >= length)
+		return;
+
+	count = std::min(std::min(count, length - start), (uint64_t)PREFETCH_WINDOW);
+	if (count == 0)
+		return;
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (void*)(bytes + start);
+	range.NumberOfBytes = (size_t)count;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t alignedStart = (size_t)start - (size_t)start % pageSize;
+	size_t alignedCount = (size_t)count + ((size_t)start - alignedStart);
+	madvise((void*)(bytes + alignedStart), alignedCount, MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+/// <summary>
+/// How a mapped region is going to be read, passed to the operating system as a hint
+/// </summary>
+enum class accessPattern {
+	sequential, //read from the beginning to the end (aggressive read ahead)
+	random //only small parts are read (no read ahead)
+};
+
+//a cursor in a file which is not mapped whole maps this many bytes after the ones it reads, so small reads share a region
+const size_t CURSOR_READ_AHEAD = 1024 * 1024;
+//large parts of a file (e.g. the ones checksummed or copied whole) are viewed this many bytes at a time
+const size_t VIEW_CHUNK_SIZE = 64 * 1024 * 1024;
+//at most this many bytes are requested ahead of the part being read, so the page cache is not flooded by a large archive
+const size_t PREFETCH_WINDOW = 64 * 1024 * 1024;
+
+/// <summary>
+/// A part of a file mapped on its own, used when the whole file does not fit into the address space
+/// (e.g. a 32-bit build reading an archive of several GB). Every reader has its own region
+/// </summary>
+class mappedRegion {
+	friend class mappedFile;
+	void* view = nullptr; //beginning of the mapping, aligned to the allocation granularity
+	size_t viewSize = 0;
+	uint64_t start = 0; //position in the file of the first byte of the region
+	size_t count = 0;
+	const unsigned char* bytes = nullptr; //the byte at start
+public:
+	mappedRegion() = default;
+	mappedRegion(const mappedRegion&) = delete;
+	mappedRegion& operator=(const mappedRegion&) = delete;
+	~mappedRegion();
+
+	void unmap();
+
+	bool contains(uint64_t pos, size_t size) const {
+		return bytes && pos >= start && pos - start <= count && size <= count - (pos - start);
+	}
+};
+
+/// <summary>
+/// A file mapped into memory: its bytes are read (or written) directly in the page cache,
+/// without copying them through stream buffers and without a system call per access.
+/// A file which is too large to be mapped whole is read through regions (see view)
+/// </summary>
+class mappedFile {
+	const unsigned char* bytes = nullptr;
+	uint64_t length = 0;
+	bool writable = false;
+	bool attached = false; //the bytes belong to the caller, nothing is mapped
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fd = -1;
+#endif
+public:
+	mappedFile() = default;
+	mappedFile(const mappedFile&) = delete;
+	mappedFile& operator=(const mappedFile&) = delete;
+	~mappedFile();
+
+	//maps the whole file read-only, returns false if it could not be opened (an empty file is mapped with no data).
+	//If the file does not fit into the address space, it stays open with no data and is read through regions
+	bool open(const std::string& path);
+	//creates (or truncates) the file, allocates size bytes for it and maps it writable, returns false on failure
+	bool create(const std::string& path, uint64_t size);
+	//creates (or truncates) the file and allocates size bytes for it without mapping it, returns false on failure
+	static bool preallocate(const std::string& path, uint64_t size);
+	//reads bytes already in memory (e.g. a block read from a pipe) the same way as a mapped file, they must outlive it
+	void attach(const unsigned char* data, size_t size);
+	void close();
+	bool isOpen() const;
+	//the bytes of the whole file (nullptr if it is read through regions)
+	const unsigned char* data() const;
+	//the mapped bytes of a file mapped by create (nullptr for read-only mappings)
+	unsigned char* writableData();
+	uint64_t size() const;
+	//the bytes [start, start + count), mapped into the region if the file is not mapped whole (nullptr if they could not be)
+	const unsigned char* view(uint64_t start, size_t count, mappedRegion& region, size_t readAhead = 0) const;
+	//tells the operating system how the region [start, start + count) is going to be read (nothing is read now)
+	void advise(accessPattern pattern, uint64_t start = 0, uint64_t count = UINT64_MAX) const;
+	//asks the operating system to read the first PREFETCH_WINDOW bytes of [start, start + count) in the background
+	void prefetch(uint64_t start, uint64_t count) const;
+};
+
+/// <summary>
+/// Reading position in a mapped file, the parsers use it the way they would use an input stream
+/// (a read past the end copies nothing and fails). Every thread may have its own cursor in the same file
+/// </summary>
+class archiveCursor {
+	const mappedFile* file;
+	uint64_t pos;
+	mappedRegion region; //the bytes around the position, if the file is not mapped whole
+public:
+	archiveCursor(const mappedFile& file, uint64_t pos = 0) : file(&file), pos(pos) {}
+	//a copy reads on its own, it maps its own region
+	archiveCursor(const archiveCursor& other) : file(other.file), pos(other.pos) {}
+
+	archiveCursor& operator=(const archiveCursor& other) {
+		file = other.file;
+		pos = other.pos;
+		region.unmap();
+		return *this;
+	}
+
+	//copies the next count bytes, returns false (and copies nothing) if fewer bytes are left
+	bool read(void* dest, size_t count) {
+		const unsigned char* bytes = take(count);
+		if (!bytes)
+			return false;
+
+		if (count > 0)
+			memcpy(dest, bytes, count);
+		return true;
+	}
+
+	void seek(uint64_t newPos) {
+		pos = newPos;
+	}
+
+	//the next count bytes without copying them (nullptr if fewer bytes are left), the position moves after them.
+	//They stay valid until the next read of the cursor
+	const unsigned char* take(size_t count) {
+		if (count > left())
+			return nullptr;
+
+		const unsigned char* bytes = file->view(pos, count, region, CURSOR_READ_AHEAD);
+		if (bytes)
+			pos += count;
+		return bytes;
+	}
+
+	uint64_t tell() const {
+		return pos;
+	}
+
+	//bytes between the position and the end of the file
+	uint64_t left() const {
+		return pos < file->size() ? file->size() - pos : 0;
+	}
+
+	const mappedFile& source() const {
+		return *file;
+	}
+};
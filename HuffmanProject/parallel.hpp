@@ -0,0 +1,245 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+const uint32_t TASKS_IN_FLIGHT_PER_THREAD = 2; //finished tasks a thread may run ahead of the one being consumed
+
+/// <summary>
+/// Runs tasks whose inputs are read one after another (e.g. from a stream of unknown length) on several threads
+/// and hands their results to the calling thread in order. Every thread has its own State.
+/// The input of a task is read by one thread at a time, in the order of the tasks, and the tasks are run
+/// once their inputs are read. A task is read only if it is at most TASKS_IN_FLIGHT_PER_THREAD tasks per thread ahead
+/// of the one being consumed, so the memory used by the inputs and the waiting results stays bounded.
+/// An exception thrown by a task stops all threads and is rethrown on the calling thread
+/// </summary>
+/// <param name="threadsCnt">threads running the tasks (the calling thread only consumes)</param>
+/// <param name="init">prepares the state of a thread</param>
+/// <param name="read">reads the input of task i into its result, returns false if there is no input left</param>
+/// <param name="produce">runs task i and fills its result</param>
+/// <param name="consume">takes the result of task i, returns false to stop</param>
+/// <returns>false if consume has stopped the tasks</returns>
+template<typename State, typename Result>
+bool runOrderedInput(uint32_t threadsCnt,
+	const std::function<void(State&)>& init,
+	const std::function<bool(size_t, Result&)>& read,
+	const std::function<void(State&, size_t, Result&)>& produce,
+	const std::function<bool(size_t, Result&)>& consume)
+{
+	struct task {
+		Result result;
+		bool done = false;
+		std::exception_ptr error;
+	};
+
+	uint32_t workersCnt = std::max(threadsCnt, 1u);
+	size_t window = (size_t)workersCnt * TASKS_IN_FLIGHT_PER_THREAD;
+	std::vector<task> tasks(window); //task i waits in tasks[i % window] until it is consumed
+	std::mutex mutex;
+	std::mutex readMutex; //held by the thread reading the next input
+	std::condition_variable cv;
+	size_t nextTask = 0; //next task to be read
+	size_t takenCnt = 0; //tasks already taken by the consumer
+	size_t count = SIZE_MAX; //number of tasks, known once the input has been read
+	bool stop = false;
+
+	auto worker = [&]() {
+		State state;
+		std::exception_ptr initError;
+		try {
+			init(state);
+		}
+		catch (...) {
+			initError = std::current_exception();
+		}
+
+		while (true)
+		{
+			size_t idx = 0;
+			Result result;
+			std::exception_ptr error = initError;
+			bool hasInput = true;
+			{
+				std::lock_guard<std::mutex> readLock(readMutex);
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					cv.wait(lock, [&] { return stop || nextTask == count || nextTask < takenCnt + window; });
+					if (stop || nextTask == count)
+						return;
+
+					idx = nextTask;
+				}
+
+				if (!error) {
+					try {
+						hasInput = read(idx, result);
+					}
+					catch (...) {
+						error = std::current_exception();
+					}
+				}
+
+				//a task which has failed is the last one
+				std::lock_guard<std::mutex> lock(mutex);
+				if (hasInput)
+					nextTask++;
+				if (!hasInput || error)
+					count = nextTask;
+			}
+
+			if (!hasInput) {
+				cv.notify_all();
+				return;
+			}
+
+			if (!error) {
+				try {
+					produce(state, idx, result);
+				}
+				catch (...) {
+					error = std::current_exception();
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				task& t = tasks[idx % window];
+				t.result = std::move(result);
+				t.error = error;
+				t.done = true;
+			}
+			cv.notify_all();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (uint32_t i = 0; i < workersCnt; i++)
+		workers.emplace_back(worker);
+
+	bool completed = true;
+	std::exception_ptr error;
+	for (size_t i = 0; ; i++)
+	{
+		Result result;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			task& t = tasks[i % window];
+			cv.wait(lock, [&] { return t.done || i == count; });
+			if (!t.done) //all the tasks have been consumed
+				break;
+
+			result = std::move(t.result);
+			error = t.error;
+			t.done = false;
+			t.error = nullptr;
+			takenCnt++;
+		}
+		cv.notify_all();
+
+		if (error)
+			break;
+
+		try {
+			if (!consume(i, result)) {
+				completed = false;
+				break;
+			}
+		}
+		catch (...) {
+			error = std::current_exception();
+			break;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	cv.notify_all();
+	for (std::thread& w : workers)
+		w.join();
+
+	if (error)
+		std::rethrow_exception(error);
+
+	return completed;
+}
+
+/// <summary>
+/// Runs count tasks on several threads and hands their results to the calling thread in order
+/// (see runOrderedInput, the tasks have no input to read)
+/// </summary>
+/// <param name="count">number of tasks</param>
+/// <param name="threadsCnt">threads running the tasks (the calling thread only consumes)</param>
+/// <param name="init">prepares the state of a thread</param>
+/// <param name="produce">runs task i and fills its result</param>
+/// <param name="consume">takes the result of task i, returns false to stop</param>
+/// <returns>false if consume has stopped the tasks</returns>
+template<typename State, typename Result>
+bool runOrdered(size_t count, uint32_t threadsCnt,
+	const std::function<void(State&)>& init,
+	const std::function<void(State&, size_t, Result&)>& produce,
+	const std::function<bool(size_t, Result&)>& consume)
+{
+	if (count == 0)
+		return true;
+
+	uint32_t workersCnt = (uint32_t)std::min((size_t)std::max(threadsCnt, 1u), count);
+	return runOrderedInput<State, Result>(workersCnt, init,
+		[count](size_t idx, Result&) {
+			return idx < count;
+		},
+		produce, consume);
+}
+
+/// <summary>
+/// Runs count tasks on several threads in no particular order: every thread takes the next task as soon as
+/// it is done with the previous one, so a long task never holds the others back.
+/// Every thread has its own State. An exception thrown by a task stops all threads and is rethrown on the calling thread
+/// </summary>
+/// <param name="count">number of tasks</param>
+/// <param name="threadsCnt">threads running the tasks</param>
+/// <param name="init">prepares the state of a thread</param>
+/// <param name="run">runs task i</param>
+template<typename State>
+void runParallel(size_t count, uint32_t threadsCnt,
+	const std::function<void(State&)>& init,
+	const std::function<void(State&, size_t)>& run)
+{
+	uint32_t workersCnt = (uint32_t)std::min((size_t)std::max(threadsCnt, 1u), count);
+	std::atomic<size_t> nextTask(0);
+	std::atomic<bool> stop(false);
+	std::mutex mutex;
+	std::exception_ptr error;
+
+	auto worker = [&]() {
+		try {
+			State state;
+			init(state);
+			for (size_t idx = nextTask++; idx < count && !stop; idx = nextTask++)
+				run(state, idx);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+				error = std::current_exception();
+			stop = true;
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (uint32_t i = 0; i < workersCnt; i++)
+		workers.emplace_back(worker);
+
+	for (std::thread& w : workers)
+		w.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
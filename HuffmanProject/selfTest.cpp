@@ -0,0 +1,517 @@
+#include "selfTest.h"
+#include "Encoder.h"
+#include "Decoder.h"
+#include "Archive.h"
+#include "crc32.hpp"
+#include "checksumBuf.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+
+const uint32_t CRC_CHECK_VALUE = 0xCBF43926; //CRC-32 of "123456789"
+const size_t CRC_LARGE_BUFFER = 1024 * 1024 + 13; //long enough for every kernel, not a multiple of their steps
+const size_t TEST_FILE_SIZE = 300 * 1000; //several blocks of MIN_BLOCK_SIZE, each large enough for STREAMS_CNT streams
+
+/// <summary>
+/// Input which gives its bytes and then fails, the way a broken pipe or a disk error does
+/// </summary>
+class failingBuf : public std::streambuf {
+public:
+	failingBuf(std::vector<unsigned char>& data) {
+		setg((char*)data.data(), (char*)data.data(), (char*)data.data() + data.size());
+	}
+protected:
+	int_type underflow() override {
+		throw std::ios_base::failure("The input could not be read");
+	}
+};
+
+/// <summary>
+/// Output which can only be written forward, the way a pipe is: every seek (and tell) fails and is counted
+/// </summary>
+class forwardOnlyBuf : public std::streambuf {
+public:
+	std::string data;
+	size_t seeks = 0; //seeks which would move the position, tells are not counted
+protected:
+	std::streamsize xsputn(const char* bytes, std::streamsize count) override {
+		data.append(bytes, (size_t)count);
+		return count;
+	}
+	int_type overflow(int_type ch) override {
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+			data.push_back(traits_type::to_char_type(ch));
+		return traits_type::not_eof(ch);
+	}
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+		if (off != 0 || dir != std::ios_base::cur)
+			seeks++;
+		return pos_type(off_type(-1));
+	}
+	pos_type seekpos(pos_type, std::ios_base::openmode) override {
+		seeks++;
+		return pos_type(off_type(-1));
+	}
+};
+
+/// <summary>
+/// Runs every check, a failed one does not stop the rest
+/// </summary>
+/// <param name="workDir">directory for the files of the checks</param>
+/// <returns>whether all the checks passed</returns>
+bool selfTest::run(const std::string& workDir)
+{
+	bool passed = true;
+	passed &= report("CRC-32 of known values", checkCrc());
+	passed &= report("CRC-32 combine", checkCrcCombine());
+	passed &= report("Checksum kept while writing", checkChecksumBuf());
+
+	fs::path dir = fs::path(workDir) / "huffman_selftest";
+	fs::remove_all(dir);
+	createInput(dir);
+
+	Encoder multiStream;
+	multiStream.setBlockSize(0);
+	multiStream.setMultiStream(true);
+	passed &= report("Archive with interleaved streams", checkArchive(dir, multiStream));
+
+	//the blocks are compressed and extracted on several threads, even on a single core
+	Encoder blocks;
+	blocks.setBlockSize(MIN_BLOCK_SIZE);
+	blocks.setMultiStream(true);
+	blocks.setThreads(3);
+	passed &= report("Archive with blocks", checkArchive(dir, blocks));
+	passed &= report("Blocks at the ends of files and a code for every block", checkBlocks(dir));
+
+	Encoder sectionChecksums;
+	sectionChecksums.setSectionChecksums(true);
+	passed &= report("Archive with section checksums", checkArchive(dir, sectionChecksums));
+	passed &= report("Archive with section checksums and a corrupted file", checkCorruptedFile(dir));
+
+	Encoder archiveChecksum;
+	archiveChecksum.setSectionChecksums(false);
+	passed &= report("Archive with only the archive checksum", checkArchive(dir, archiveChecksum));
+
+	//the block and stream tables follow their data in archives with a footer
+	Encoder footer;
+	footer.setFooter(true);
+	footer.setBlockSize(MIN_BLOCK_SIZE);
+	footer.setMultiStream(true);
+	passed &= report("Archive with a footer", checkArchive(dir, footer));
+	passed &= report("Archive with a footer written without seeking", checkFooterWithoutSeeking(dir));
+
+	//64-bit sizes and positions are written for small archives too when they are asked for
+	Encoder large;
+	large.setLargeFiles(true);
+	large.setMultiStream(true);
+	passed &= report("Archive with 64-bit positions", checkArchive(dir, large));
+
+	Encoder largeFooter;
+	largeFooter.setLargeFiles(true);
+	largeFooter.setFooter(true);
+	passed &= report("Archive with 64-bit positions and a footer", checkArchive(dir, largeFooter));
+	passed &= report("64-bit positions chosen by the input size", checkLargeFlags(dir));
+
+	passed &= report("Compressed stream", checkStream());
+	passed &= report("Truncated compressed stream", checkTruncatedStream());
+	passed &= report("Input stream with a read error", checkStreamReadError());
+
+	fs::remove_all(dir);
+	return passed;
+}
+
+/// <summary>
+/// Compares the CRC-32 of the standard check string, then of buffers of every length up to a few
+/// steps of the kernels at every alignment, and of a large buffer, with the byte by byte computation
+/// </summary>
+/// <returns>whether all the checksums are right</returns>
+bool selfTest::checkCrc()
+{
+	const char check[] = "123456789";
+	if (crc_32::getChecksum((const unsigned char*)check, sizeof(check) - 1) != CRC_CHECK_VALUE)
+		return false;
+
+	std::vector<unsigned char> data = pseudoRandom(CRC_LARGE_BUFFER, 1);
+	for (size_t offset = 0; offset < 16; offset++)
+	{
+		for (size_t size = 0; size <= 300; size++)
+		{
+			if (crc_32::getChecksum(data.data() + offset, size) != referenceCrc(data.data() + offset, size))
+				return false;
+		}
+	}
+	return crc_32::getChecksum(data.data(), data.size()) == referenceCrc(data.data(), data.size());
+}
+
+/// <summary>
+/// Splits a buffer at several positions (including its ends) and combines the checksums of the parts
+/// </summary>
+/// <returns>whether every combined checksum is the one of the whole buffer</returns>
+bool selfTest::checkCrcCombine()
+{
+	std::vector<unsigned char> data = pseudoRandom(100000, 2);
+	uint32_t whole = crc_32::getChecksum(data.data(), data.size());
+	for (size_t split : { (size_t)0, (size_t)1, (size_t)15, (size_t)4096, (size_t)99999, data.size() })
+	{
+		uint32_t first = crc_32::getChecksum(data.data(), split);
+		uint32_t second = crc_32::getChecksum(data.data() + split, data.size() - split);
+		if (crc_32::combineCRC(first, second, data.size() - split) != whole)
+			return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Writes the way an archive is written: reserved zeroes, the data, then the reserved space
+/// written after a seek back, and the writing goes on at the end
+/// </summary>
+/// <returns>whether the kept checksum is the one of the written bytes</returns>
+bool selfTest::checkChecksumBuf()
+{
+	std::vector<unsigned char> data = pseudoRandom(10000, 3);
+	uint64_t reserved = 0;
+	uint64_t patch = 0x0123456789ABCDEF;
+	std::stringbuf written(std::ios::out | std::ios::binary);
+	checksumBuf checksum(&written);
+	std::ostream out(&checksum);
+	out.write((char*)&reserved, sizeof(reserved));
+	out.write((char*)data.data(), data.size());
+	out.seekp(0);
+	out.write((char*)&patch, sizeof(patch));
+	out.seekp(sizeof(reserved) + data.size());
+	out.write((char*)data.data(), 100);
+	out.flush();
+
+	std::string bytes = written.str();
+	return out.good() && bytes.size() == sizeof(reserved) + data.size() + 100
+		&& checksum.checksum() == crc_32::getChecksum((const unsigned char*)bytes.data(), bytes.size());
+}
+
+/// <summary>
+/// Archives dir/input into dir/archive.huf, checks the archive and extracts it into dir/output
+/// </summary>
+/// <param name="dir">directory of the checks</param>
+/// <param name="enc">encoder with the settings of the checked format</param>
+/// <returns>whether the archive is intact and its files are the same as the input</returns>
+bool selfTest::checkArchive(const fs::path& dir, Encoder& enc)
+{
+	fs::path input = dir / "input";
+	fs::path archive = dir / "archive.huf";
+	fs::path output = dir / "output";
+	fs::remove_all(output);
+	fs::create_directories(output);
+
+	Decoder dec;
+	return enc.encode(input.string(), archive.string()) && dec.checkIntegrity(archive.string())
+		&& dec.decode(archive.string(), output.string()) && sameFiles(input, output / "input");
+}
+
+/// <summary>
+/// Archives files whose last block is full, has a single byte, or is their only block, on several threads,
+/// and a file whose bytes change their distribution, which must take less space with a code for every block
+/// </summary>
+/// <param name="dir">directory of the checks</param>
+/// <returns>whether the files are extracted the same and the blocks adapt to the data</returns>
+bool selfTest::checkBlocks(const fs::path& dir)
+{
+	fs::path input = dir / "blocks";
+	fs::path output = dir / "output";
+	fs::path archive = dir / "archive.huf";
+	fs::path singleArchive = dir / "single.huf";
+	fs::remove_all(input);
+	fs::remove_all(output);
+	fs::create_directories(input);
+	fs::create_directories(output);
+
+	std::vector<unsigned char> random = pseudoRandom(3 * MIN_BLOCK_SIZE, 8);
+	writeFile(input / "full.bin", std::vector<unsigned char>(random.begin(), random.begin() + 2 * MIN_BLOCK_SIZE));
+	writeFile(input / "byte.bin", std::vector<unsigned char>(random.begin(), random.begin() + 2 * MIN_BLOCK_SIZE + 1));
+	writeFile(input / "single.bin", std::vector<unsigned char>(random.begin(), random.begin() + MIN_BLOCK_SIZE));
+	std::vector<unsigned char> changing = random;
+	changing.resize(2 * random.size()); //random bytes, then a single symbol
+	writeFile(input / "changing.bin", changing);
+
+	Encoder blocks;
+	blocks.setBlockSize(MIN_BLOCK_SIZE);
+	blocks.setThreads(3);
+	Decoder dec;
+	dec.setThreads(3);
+	if (!blocks.encode(input.string(), archive.string()) || !dec.decode(archive.string(), output.string())
+		|| !sameFiles(input, output / "blocks"))
+		return false;
+
+	Encoder single;
+	single.setBlockSize(0);
+	if (!single.encode(input.string(), singleArchive.string()))
+		return false;
+
+	Archive withBlocks;
+	Archive withoutBlocks;
+	long long blocksIndex = withBlocks.open(archive.string()) ? withBlocks.find("changing.bin") : -1;
+	long long singleIndex = withoutBlocks.open(singleArchive.string()) ? withoutBlocks.find("changing.bin") : -1;
+	if (blocksIndex == -1 || singleIndex == -1)
+		return false;
+
+	const fileInfo& blocksFile = withBlocks.getFiles()[blocksIndex];
+	const fileInfo& singleFile = withoutBlocks.getFiles()[singleIndex];
+	return blocksFile.endPos - blocksFile.startPos < singleFile.endPos - singleFile.startPos;
+}
+
+/// <summary>
+/// Flips a byte in the middle of one compressed file of an archive with section checksums, then extracts it
+/// </summary>
+/// <param name="dir">directory of the checks</param>
+/// <returns>whether only the corrupted file has been rejected and the rest is the same as the input</returns>
+bool selfTest::checkCorruptedFile(const fs::path& dir)
+{
+	fs::path input = dir / "input";
+	fs::path archive = dir / "archive.huf";
+	fs::path output = dir / "output";
+	fs::path expected = dir / "expected";
+	fs::remove_all(output);
+	fs::create_directories(output);
+	fs::remove_all(expected);
+	fs::copy(input, expected, fs::copy_options::recursive);
+	fs::remove(expected / "text.txt");
+
+	Encoder enc;
+	enc.setSectionChecksums(true);
+	if (!enc.encode(input.string(), archive.string()))
+		return false;
+
+	uint64_t corruptedPos = 0;
+	{
+		Archive opened;
+		long long index = opened.open(archive.string()) ? opened.find("text.txt") : -1;
+		if (index == -1)
+			return false;
+
+		const fileInfo& file = opened.getFiles()[index];
+		corruptedPos = file.startPos + (file.endPos - file.startPos) / 2;
+	}
+
+	std::fstream archiveFile(archive, std::ios::in | std::ios::out | std::ios::binary);
+	archiveFile.seekg(corruptedPos);
+	char byte = (char)archiveFile.get();
+	archiveFile.seekp(corruptedPos);
+	archiveFile.put(byte ^ (char)0xFF);
+	archiveFile.close();
+
+	//the whole archive is no longer intact, but its metadata is, so the other files are extracted
+	Decoder dec;
+	bool extracted = dec.decode(archive.string(), output.string());
+	return !extracted && !dec.checkIntegrity(archive.string()) && !fs::exists(output / "input" / "text.txt")
+		&& sameFiles(expected, output / "input");
+}
+
+/// <summary>
+/// Writes an archive with a footer to an output which cannot seek, then extracts it
+/// </summary>
+/// <param name="dir">directory of the checks</param>
+/// <returns>whether nothing has been sought and the archive gives back the input</returns>
+bool selfTest::checkFooterWithoutSeeking(const fs::path& dir)
+{
+	fs::path input = dir / "input";
+	fs::path archive = dir / "archive.huf";
+	fs::path output = dir / "output";
+	fs::remove_all(output);
+	fs::create_directories(output);
+
+	Encoder enc;
+	enc.setFooter(true);
+	enc.setBlockSize(MIN_BLOCK_SIZE);
+	enc.setMultiStream(true);
+	enc.setThreads(3);
+	forwardOnlyBuf written;
+	if (!enc.encode(input.string(), &written) || written.seeks != 0)
+		return false;
+
+	writeFile(archive, std::vector<unsigned char>(written.data.begin(), written.data.end()));
+	Decoder dec;
+	return dec.checkIntegrity(archive.string()) && dec.decode(archive.string(), output.string())
+		&& sameFiles(input, output / "input");
+}
+
+/// <summary>
+/// Checks that FLAG_LARGE (with FLAG_BLOCKS) is chosen from LARGE_ARCHIVE_MIN_INPUT bytes of input on, or when it is asked for,
+/// and that it is written into the archive header
+/// </summary>
+/// <param name="dir">directory of the checks</param>
+/// <returns>whether the flags are the expected ones</returns>
+bool selfTest::checkLargeFlags(const fs::path& dir)
+{
+	uint16_t large = FLAG_LARGE | FLAG_BLOCKS;
+	if (Encoder::archiveFlags(FORMAT_CANONICAL, FLAG_MULTI_STREAM, LARGE_ARCHIVE_MIN_INPUT) != (FLAG_MULTI_STREAM | large)
+		|| Encoder::archiveFlags(FORMAT_CANONICAL, FLAG_FOOTER, (uint64_t)UINT32_MAX * 3) != (FLAG_FOOTER | large)
+		|| Encoder::archiveFlags(FORMAT_CANONICAL, FLAG_MULTI_STREAM, LARGE_ARCHIVE_MIN_INPUT - 1) != FLAG_MULTI_STREAM
+		|| Encoder::archiveFlags(FORMAT_CANONICAL, FLAG_LARGE, 0) != large
+		|| Encoder::archiveFlags(FORMAT_LEGACY, 0, LARGE_ARCHIVE_MIN_INPUT) != 0)
+		return false;
+
+	fs::path archive = dir / "archive.huf";
+	Encoder enc;
+	enc.setBlockSize(0);
+	enc.setLargeFiles(true);
+	if (!enc.encode((dir / "input").string(), archive.string()))
+		return false;
+
+	Archive opened;
+	return opened.open(archive.string()) && (opened.getFormatFlags() & large) == large;
+}
+
+/// <summary>
+/// Compresses data of several kinds as a stream of blocks on several threads and decompresses it
+/// </summary>
+/// <returns>whether the decompressed data is the same</returns>
+bool selfTest::checkStream()
+{
+	std::vector<unsigned char> data = pseudoRandom(TEST_FILE_SIZE, 5);
+	data.resize(2 * TEST_FILE_SIZE); //the second half is a single symbol
+	std::istringstream input(std::string(data.begin(), data.end()), std::ios::in | std::ios::binary);
+	std::stringstream compressed(std::ios::in | std::ios::out | std::ios::binary);
+	std::ostringstream output(std::ios::out | std::ios::binary);
+
+	Encoder enc;
+	enc.setBlockSize(MIN_BLOCK_SIZE);
+	enc.setMultiStream(true);
+	enc.setThreads(3);
+	Decoder dec;
+	dec.setThreads(3);
+	return enc.encodeStream(input, compressed) && dec.decodeStream(compressed, output)
+		&& output.str() == std::string(data.begin(), data.end());
+}
+
+/// <summary>
+/// Drops the end of a compressed stream (the block ending it and a part of the last data block)
+/// </summary>
+/// <returns>whether the decompression has failed</returns>
+bool selfTest::checkTruncatedStream()
+{
+	std::vector<unsigned char> data = pseudoRandom(TEST_FILE_SIZE, 6);
+	std::istringstream input(std::string(data.begin(), data.end()), std::ios::in | std::ios::binary);
+	std::ostringstream compressed(std::ios::out | std::ios::binary);
+	Encoder enc;
+	enc.setBlockSize(MIN_BLOCK_SIZE);
+	if (!enc.encodeStream(input, compressed))
+		return false;
+
+	std::string truncated = compressed.str();
+	truncated.resize(truncated.size() - 2 * sizeof(streamBlockHeader));
+	std::istringstream truncatedInput(truncated, std::ios::in | std::ios::binary);
+	std::ostringstream output(std::ios::out | std::ios::binary);
+	Decoder dec;
+	try {
+		dec.decodeStream(truncatedInput, output);
+	}
+	catch (const std::exception&) {
+		return true;
+	}
+	return false;
+}
+
+/// <summary>
+/// Compresses an input which fails after a few blocks
+/// </summary>
+/// <returns>whether the compression has failed</returns>
+bool selfTest::checkStreamReadError()
+{
+	std::vector<unsigned char> data = pseudoRandom(TEST_FILE_SIZE, 7);
+	failingBuf failing(data);
+	std::istream input(&failing);
+	std::ostringstream compressed(std::ios::out | std::ios::binary);
+	Encoder enc;
+	enc.setBlockSize(MIN_BLOCK_SIZE);
+	return !enc.encodeStream(input, compressed);
+}
+
+/// <summary>
+/// Writes the files every archive check compresses
+/// </summary>
+/// <param name="dir">directory of the checks</param>
+void selfTest::createInput(const fs::path& dir)
+{
+	fs::path input = dir / "input";
+	fs::create_directories(input / "sub");
+
+	//text: words of different frequencies, so the code has lengths of every size
+	const char* words[] = { "the ", "huffman ", "code ", "of ", "a ", "block\n", "stream ", "x" };
+	std::vector<unsigned char> random = pseudoRandom(TEST_FILE_SIZE, 4);
+	std::vector<unsigned char> text;
+	for (size_t i = 0; text.size() < TEST_FILE_SIZE; i++)
+	{
+		unsigned char r = random[i % random.size()];
+		const char* word = words[(r & 7) & (r >> 3 & 7)];
+		text.insert(text.end(), word, word + strlen(word));
+	}
+
+	writeFile(input / "text.txt", text);
+	writeFile(input / "random.bin", random);
+	writeFile(input / "zeros.bin", std::vector<unsigned char>(TEST_FILE_SIZE / 3));
+	writeFile(input / "sub" / "empty.txt", std::vector<unsigned char>());
+	writeFile(input / "sub" / "one.txt", std::vector<unsigned char>(1, 'x'));
+}
+
+void selfTest::writeFile(const fs::path& path, const std::vector<unsigned char>& data)
+{
+	std::ofstream file(path, std::ios::out | std::ios::binary);
+	file.write((const char*)data.data(), data.size());
+}
+
+/// <summary>
+/// Compares two directories file by file
+/// </summary>
+/// <param name="expected">the original files</param>
+/// <param name="actual">the extracted files</param>
+/// <returns>whether the directories hold the same files</returns>
+bool selfTest::sameFiles(const fs::path& expected, const fs::path& actual)
+{
+	size_t expectedCnt = 0;
+	for (const fs::directory_entry& entry : fs::recursive_directory_iterator(expected))
+	{
+		if (!entry.is_regular_file())
+			continue;
+
+		expectedCnt++;
+		std::ifstream expectedFile(entry.path(), std::ios::in | std::ios::binary);
+		std::ifstream actualFile(actual / fs::relative(entry.path(), expected), std::ios::in | std::ios::binary);
+		if (!actualFile)
+			return false;
+
+		std::string expectedData((std::istreambuf_iterator<char>(expectedFile)), std::istreambuf_iterator<char>());
+		std::string actualData((std::istreambuf_iterator<char>(actualFile)), std::istreambuf_iterator<char>());
+		if (expectedData != actualData)
+			return false;
+	}
+
+	size_t actualCnt = 0;
+	for (const fs::directory_entry& entry : fs::recursive_directory_iterator(actual))
+		actualCnt += entry.is_regular_file() ? 1 : 0;
+
+	return actualCnt == expectedCnt;
+}
+
+std::vector<unsigned char> selfTest::pseudoRandom(size_t size, uint32_t seed)
+{
+	std::vector<unsigned char> data(size);
+	uint32_t state = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		state = state * 1664525 + 1013904223;
+		data[i] = (unsigned char)(state >> 24);
+	}
+	return data;
+}
+
+uint32_t selfTest::referenceCrc(const unsigned char* data, size_t size)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < size; i++)
+		crc_32::updateCRC(crc, data[i]);
+	return crc ^ 0xFFFFFFFF;
+}
+
+bool selfTest::report(const std::string& name, bool passed)
+{
+	std::cout << name << ": " << (passed ? "OK" : "FAILED") << std::endl;
+	return passed;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+class Encoder;
+
+/// <summary>
+/// Checks of the parts whose results can only be verified by running them: the CRC-32 kernels
+/// against known values, the checksum kept while an archive is written, and archives of every format
+/// and compressed streams decompressed back into the data they were made of. Every check prints its result
+/// </summary>
+class selfTest {
+public:
+	//runs all the checks (files are written to a directory of its own in workDir, removed afterwards), returns whether all passed
+	static bool run(const std::string& workDir);
+private:
+	//CRC-32 of "123456789" and of buffers of every alignment, compared with the byte by byte table lookup
+	static bool checkCrc();
+	//checksum of two parts combined from their checksums
+	static bool checkCrcCombine();
+	//checksum kept while writing, with space reserved at the beginning and written after a seek back
+	static bool checkChecksumBuf();
+	//archives the input with the encoder's settings, checks the archive and extracts it, the files must be the same
+	static bool checkArchive(const std::filesystem::path& dir, Encoder& enc);
+	//files split into blocks at the block boundaries, and blocks compressed with codes of their own
+	static bool checkBlocks(const std::filesystem::path& dir);
+	//a corrupted file of an archive with section checksums must not be extracted, the other files must be
+	static bool checkCorruptedFile(const std::filesystem::path& dir);
+	//an archive with a footer written to an output which cannot seek (e.g. a pipe) must be complete
+	static bool checkFooterWithoutSeeking(const std::filesystem::path& dir);
+	//archives of LARGE_ARCHIVE_MIN_INPUT bytes and more (or asked to) get FLAG_LARGE and FLAG_BLOCKS
+	static bool checkLargeFlags(const std::filesystem::path& dir);
+	//compresses a stream and decompresses it, the data must be the same
+	static bool checkStream();
+	//a stream which ends too early must not be decompressed
+	static bool checkTruncatedStream();
+	//an input which cannot be read to its end must not be compressed into a complete stream
+	static bool checkStreamReadError();
+
+	//writes files of different kinds into dir/input (text, random bytes, one symbol, empty, one byte)
+	static void createInput(const std::filesystem::path& dir);
+	static void writeFile(const std::filesystem::path& path, const std::vector<unsigned char>& data);
+	//whether every file of the first directory is in the second one with the same contents, and nothing else is
+	static bool sameFiles(const std::filesystem::path& expected, const std::filesystem::path& actual);
+
+	//bytes which are the same on every run (a linear congruential generator)
+	static std::vector<unsigned char> pseudoRandom(size_t size, uint32_t seed);
+	//crc of a buffer computed one byte at a time, the reference for the faster kernels
+	static uint32_t referenceCrc(const unsigned char* data, size_t size);
+	//prints the result of a check and passes it on
+	static bool report(const std::string& name, bool passed);
+};